@@ -4,8 +4,12 @@
 #include <mutex>
 
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
 #include "hal/gpio_types.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
 #include "task/Aperiodic.hpp"
+#include "utils/Realtime.hpp"
 
 namespace Peripherals {
   namespace {
@@ -42,6 +46,57 @@ namespace Peripherals {
       { Output{ copy } } -> std::same_as<T>;
     };
 
+    /// Serializes read-modify-writes of the output registers across
+    /// every Port, and across cores
+    inline portMUX_TYPE port_lock = portMUX_INITIALIZER_UNLOCKED;
+
+    /**
+     * @brief Several outputs driven together through the output
+     * registers, so they all switch on the same clock edge instead of
+     * one gpio_set_level() call at a time.
+     *
+     * The ESP32 splits its outputs in two banks, GPIO 0-31 (out) and
+     * GPIO 32-39 (out1). Pins within a single bank switch in a single
+     * register write.
+     *
+     * @tparam pins GPIO pins of the port, each set up as an Output first.
+     *
+     * @note write() reads the bank, changes the port's bits and writes
+     * it back. A gpio_set_level() on another pin of the bank from the
+     * other core in between would be undone, so pins sharing a bank
+     * with a port must go through a Port as well, or not be GPIO
+     * outputs at all (RMT and LEDC outputs are routed past it).
+     */
+    template <uint8_t... pins>
+    struct Port {
+      static_assert(sizeof...(pins) > 0, "A port needs at least one pin!");
+
+      /// Bit of each pin, as used by write()
+      static constexpr uint64_t MASK = ((uint64_t{ 1 } << pins) | ...);
+
+      static constexpr auto bit(uint8_t pin) -> uint64_t { return uint64_t{ 1 } << pin; }
+
+      /**
+       * @brief Drive every pin of the port at once, high where its bit
+       * in levels is set and low otherwise, in one write per bank.
+       */
+      static auto write(uint64_t levels) -> void {
+        taskENTER_CRITICAL(&port_lock);
+        // Banks without any pin of the port are skipped at compile time
+        if constexpr (static_cast<uint32_t>(MASK) != 0)
+          update<GPIO_OUT_REG>(static_cast<uint32_t>(MASK), static_cast<uint32_t>(levels));
+        if constexpr ((MASK >> 32) != 0)
+          update<GPIO_OUT1_REG>(static_cast<uint32_t>(MASK >> 32), static_cast<uint32_t>(levels >> 32));
+        taskEXIT_CRITICAL(&port_lock);
+      }
+
+     private:
+      template <uint32_t reg>
+      static auto update(uint32_t mask, uint32_t levels) -> void {
+        REG_WRITE(reg, (REG_READ(reg) & ~mask) | (levels & mask));
+      }
+    };
+
     enum class Edge : uint8_t {
       RISING = GPIO_INTR_POSEDGE,
       FALLING = GPIO_INTR_NEGEDGE,
@@ -56,6 +111,8 @@ namespace Peripherals {
 
     template <uint8_t p, Edge e, Pull pu = Pull::NONE>
     struct Input {
+      static_assert(pu == Pull::NONE or p < 34, "GPIO 34 to 39 are input-only and have no internal pull resistors");
+
       static constexpr auto pin = p;
       static constexpr auto edge = e;
       static constexpr auto pull = pu;
@@ -78,7 +135,7 @@ namespace Peripherals {
 
       static auto register_interrupt(Task::isr_handler_t isr_handler_ptr, void* arg) -> void {
         initialize();
-        std::call_once(installed, gpio_install_isr_service, 0);
+        std::call_once(installed, gpio_install_isr_service, REALTIME_INTR_FLAGS);
         gpio_isr_handler_add((gpio_num_t)pin, isr_handler_ptr, arg);
       }
 
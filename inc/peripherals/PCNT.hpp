@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+
+#include "driver/gpio.h"
+#include "driver/pulse_cnt.h"
+#include "esp_err.h"
+
+namespace Peripherals {
+  /**
+   * @brief Wrapper for the ESP32 PCNT (pulse counter) peripheral, counting
+   * the falling edges of a pin.
+   *
+   * The hardware counter is 16 bits wide, so it wraps back to 0 every
+   * `limit` edges, with an event each time. One more watch point can be
+   * set anywhere below that for an event in between.
+   *
+   * @tparam pin The GPIO pin to count on. It may be an output driven by
+   * another peripheral, its input path is enabled on top.
+   * @tparam limit Edges per wrap of the counter, at most 32767.
+   * @tparam glitch_ns Pulses shorter than this aren't counted, 0 counts
+   * everything. The filter runs on the APB clock and stops at about 12 µs.
+   */
+  template <uint8_t pin, int limit = 0x7FFF, uint32_t glitch_ns = 0>
+  class PCNT {
+    static_assert(limit > 1 and limit <= 0x7FFF, "The counter holds 15 bits!");
+
+   private:
+    pcnt_unit_handle_t unit = NULL;
+    pcnt_channel_handle_t channel = NULL;
+    // Watch point besides the limit, 0 if none
+    int watching = 0;
+
+   public:
+    static constexpr int LIMIT = limit;
+
+    PCNT() {
+      pcnt_unit_config_t config = {
+        .low_limit = -1,
+        .high_limit = limit,
+        .intr_priority = 0,
+        .flags = {},
+      };
+      ESP_ERROR_CHECK(pcnt_new_unit(&config, &unit));
+
+      pcnt_chan_config_t channel_config = {
+        .edge_gpio_num = pin,
+        .level_gpio_num = -1,
+        .flags = {},
+      };
+      ESP_ERROR_CHECK(pcnt_new_channel(unit, &channel_config, &channel));
+      ESP_ERROR_CHECK(pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_HOLD, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
+      ESP_ERROR_CHECK(pcnt_unit_add_watch_point(unit, limit));
+
+      if constexpr (glitch_ns > 0) {
+        pcnt_glitch_filter_config_t filter = { .max_glitch_ns = glitch_ns };
+        ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(unit, &filter));
+      }
+
+      // Whoever drives the pin set it up as an output only
+      gpio_input_enable(static_cast<gpio_num_t>(pin));
+
+      pcnt_unit_enable(unit);
+      pcnt_unit_start(unit);
+    }
+
+    /**
+     * @brief Register a callback for every watch point reached, the limit
+     * included.
+     *
+     * @param callback Called from the PCNT ISR, so it must live in IRAM.
+     * @param arg User context handed back to the callback.
+     *
+     * @note The driver only accepts callbacks while the unit is disabled,
+     * so this briefly disables it. Don't call it while counting.
+     */
+    auto on_reach(pcnt_watch_cb_t callback, void* arg) -> void {
+      pcnt_event_callbacks_t callbacks = {
+        .on_reach = callback,
+      };
+
+      pcnt_unit_stop(unit);
+      pcnt_unit_disable(unit);
+      ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(unit, &callbacks, arg));
+      pcnt_unit_enable(unit);
+      pcnt_unit_start(unit);
+    }
+
+    /**
+     * @brief Move the extra watch point, 0 or the limit to have none.
+     */
+    auto watch(int count) -> void {
+      if (count == watching)
+        return;
+
+      if (watching != 0)
+        ESP_ERROR_CHECK(pcnt_unit_remove_watch_point(unit, watching));
+
+      watching = count > 0 and count < limit ? count : 0;
+      if (watching != 0)
+        ESP_ERROR_CHECK(pcnt_unit_add_watch_point(unit, watching));
+    }
+
+    /**
+     * @brief Restart counting from 0.
+     */
+    auto clear() -> void { pcnt_unit_clear_count(unit); }
+
+    /**
+     * @brief Edges counted since the last clear() or wrap.
+     */
+    auto count() const -> int {
+      int value = 0;
+      pcnt_unit_get_count(unit, &value);
+      return value;
+    }
+
+    ~PCNT() {
+      if (unit) {
+        pcnt_unit_stop(unit);
+        pcnt_unit_disable(unit);
+      }
+
+      if (channel)
+        pcnt_del_channel(channel);
+
+      if (unit)
+        pcnt_del_unit(unit);
+    }
+  };
+}  // namespace Peripherals
@@ -7,6 +7,7 @@
 #include "driver/ledc.h"
 #include "esp_err.h"
 #include "hal/ledc_types.h"
+#include "utils/Realtime.hpp"
 
 namespace Peripherals {
   namespace {
@@ -50,6 +51,22 @@ namespace Peripherals {
     static constexpr auto RESOLUTION = LEDC_TIMER_13_BIT;
     static constexpr auto MAX_DUTY = (1 << RESOLUTION) - 1;
     static constexpr auto TIMER_FREQ = 4000;
+    /// APB clock the timer divides down, picked for every frequency
+    /// from MIN_FREQ up
+    static constexpr uint32_t CLOCK_HZ = 80'000'000;
+    /// Frequencies the divider reaches at RESOLUTION, it's a fixed point
+    /// number with 10 integer and 8 fractional bits
+    static constexpr uint32_t MIN_FREQ = CLOCK_HZ / ((1 << RESOLUTION) * 1023) + 1;
+    static constexpr uint32_t MAX_FREQ = CLOCK_HZ / (1 << RESOLUTION);
+
+    /**
+     * @brief Divider set() ends up with for a frequency, in 256ths.
+     * Being rounded to one, frequencies come out slightly off.
+     */
+    static constexpr auto divider(uint32_t freq) -> uint64_t {
+      const auto ticks = uint64_t{ freq } << RESOLUTION;
+      return ((uint64_t{ CLOCK_HZ } << 8) + ticks / 2) / ticks;
+    }
 
     PWM() {
       std::call_once(setup[static_cast<ledc_timer_t>(timer)], install_timer_service, static_cast<ledc_timer_t>(timer), RESOLUTION, TIMER_FREQ);
@@ -73,6 +90,21 @@ namespace Peripherals {
       ledc_update_duty(SPEED_MODE, static_cast<ledc_channel_t>(channel));
     }
 
+    /**
+     * @brief Cut the output to low right away, instead of at the end of
+     * the current period like stop(). The next set() starts it again.
+     *
+     * Safe to call from an interrupt, from IRAM too with
+     * CONFIG_LEDC_CTRL_FUNC_IN_IRAM.
+     */
+    REALTIME_ATTR auto halt() -> void { ledc_stop(SPEED_MODE, static_cast<ledc_channel_t>(channel), 0); }
+
+    /**
+     * @brief Start the timer's period over from now. Shared by every
+     * channel on the timer.
+     */
+    auto restart() -> void { ledc_timer_rst(SPEED_MODE, static_cast<ledc_timer_t>(timer)); }
+
     auto set(uint32_t freq, double duty_cycle) -> void {
       if (freq == 0)
         return stop();
@@ -70,6 +70,25 @@ namespace Peripherals {
         join();
     }
 
+    /**
+     * @brief Register a callback for the end of every transaction.
+     *
+     * @param callback Called from the RMT ISR, so it must live in IRAM.
+     * @param arg User context handed back to the callback.
+     *
+     * @note The driver only accepts callbacks while the channel is
+     * disabled, so this briefly disables it. Don't call it mid-transmission.
+     */
+    auto on_done(rmt_tx_done_callback_t callback, void* arg) -> void {
+      rmt_tx_event_callbacks_t callbacks = {
+        .on_trans_done = callback,
+      };
+
+      rmt_disable(channel);
+      ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(channel, &callbacks, arg));
+      rmt_enable(channel);
+    }
+
     /**
      * @brief Wait for the current transmission to finish.
      */
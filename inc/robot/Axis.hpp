@@ -1,50 +1,257 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstdlib>
 #include <thread>
 
 #include "peripherals/GPIO.hpp"
 #include "robot/Motor.hpp"
+#include "robot/Planner.hpp"
+#include "robot/Shaper.hpp"
 #include "utils/Percentage.hpp"
 
 namespace Robot {
+  /**
+   * @brief Commanded state of an axis, enough to plan its next move.
+   */
+  struct AxisState {
+    /// Target of the last move, in finest steps from home
+    int32_t steps;
+    /// Driver indexer position at the end of it, see Motor::phase()
+    int32_t phase;
+  };
+
   template <IsMotor Motor, Peripherals::GPIO::IsInput EndSensor>
   class Axis final {
    private:
     Motor motor;
-    uint16_t pos = 0;
+    // Target of the last move, in the motor's finest steps. Positions
+    // are tracked in steps so that rounding never accumulates.
+    int32_t target = 0;
+
+    // In the motor's finest steps
+    uint32_t steps_at_100percent = 0;
+
+    // Steps per unit of Utils::Percentage and units per step, as Q40
+    // fixed point, so that conversions are a multiply and a shift
+    static constexpr int Q = 40;
+    // Longest stroke the conversions stay exact and within 64 bits for
+    static constexpr uint32_t MAX_STROKE = 1 << 24;
+    uint64_t steps_per_unit = 0;
+    uint64_t units_per_step = 0;
+
+    Shaper shaper;
+    // For the segments shaper() leaves alone
+    static inline const Shaper UNSHAPED = {};
+
+    static auto direction_of(int32_t steps) -> typename Motor::Direction {
+      return steps > 0 ? Motor::Direction::COUNTER_CLOCKWISE : Motor::Direction::CLOCKWISE;
+    }
+
+    // Only the longest segment of a move is shaped. The fine lead-in and
+    // tail around a rapid are under one coarse step each, too short to
+    // excite the frame, and shaping them as well would add the shaper's
+    // delay up to three times per move.
+    auto shaper_for(const Plan& segments, const Segment& segment) const -> const Shaper& {
+      const auto longest = std::max_element(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) { return std::abs(a.steps) < std::abs(b.steps); });
+      return &segment == &*longest ? shaper : UNSHAPED;
+    }
+
+    // Rounded to the nearest step, halves up. Rounding the reciprocal up
+    // keeps it exact: its error stays under 1e-6 of a step, and targets
+    // that aren't a half step are at least that far from one.
+    auto to_steps(uint32_t percentage) const -> int32_t {
+      return static_cast<int32_t>((percentage * steps_per_unit + (uint64_t{ 1 } << (Q - 1))) >> Q);
+    }
+
+    auto to_percentage(int32_t steps) const -> uint32_t {
+      return static_cast<uint32_t>((static_cast<uint64_t>(steps) * units_per_step + (uint64_t{ 1 } << (Q - 1))) >> Q);
+    }
+
+    /// Reciprocals of the stroke, the only divisions conversions need
+    auto set_stroke(uint32_t steps) -> void {
+      using namespace Utils::literals;
+      const uint64_t units = 100_percent;
 
-    uint16_t steps_at_100percent = 0;
+      if (steps >= MAX_STROKE)
+        Utils::println<Utils::Colors::YELLOW>("Stroke of {} steps is too long, capped to {}", steps, MAX_STROKE - 1);
+
+      steps_at_100percent = std::min(steps, MAX_STROKE - 1);
+      steps_per_unit = ((uint64_t{ steps_at_100percent } << Q) + units - 1) / units;
+      units_per_step = steps_at_100percent == 0 ? 0 : ((units << Q) + steps_at_100percent - 1) / steps_at_100percent;
+    }
 
    public:
+    /// DIR pin of the motor and how long it takes to settle, for setting
+    /// the directions of several axes in a single write
+    static constexpr auto DIR_PIN = Motor::DIR_PIN;
+    static constexpr auto DIR_SETUP_US = Motor::DIR_SETUP_US;
+
+    /// Homing creeps towards the endstop at this many coarse steps per
+    /// second whatever the Feed override, slow enough to stop on it
+    static constexpr uint32_t HOMING_RATE = 200;
+    static_assert(HOMING_RATE >= Motor::MIN_RATE and HOMING_RATE <= Motor::MAX_RATE, "The motor can't step at the homing rate!");
+
     Axis() {}
 
-    auto move(uint16_t target_percentage, bool sync = false) -> void {
+    /**
+     * @brief Where the axis will be once its queued moves are done.
+     */
+    auto state() const -> AxisState { return { .steps = target, .phase = motor.phase() }; }
+
+    /**
+     * @brief Everything besides the targets that plans from a state
+     * depend on, so that cached plans can be told apart.
+     */
+    auto plan_inputs(const AxisState& from) const -> std::array<int32_t, 3> {
+      return { static_cast<int32_t>(steps_at_100percent), from.steps, Planner<typename Motor::Modes>::offset(from.phase) };
+    }
+
+    /**
+     * @brief Work out the segments of a move without running it.
+     *
+     * @param from State the move starts from, advanced to where it ends
+     * so that whole trajectories can be planned ahead.
+     * @param target_percentage Where to go.
+     *
+     * @return The segments to hand to run(), all empty if the target is
+     * out of range.
+     */
+    auto plan(AxisState& from, uint32_t target_percentage) const -> Plan {
+      using namespace Utils::literals;
+      if (target_percentage > 100_percent)
+        return {};
+
+      // From absolute positions, so that rounding never accumulates and a
+      // closed path always brings the axis back to the same step
+      const auto segments = Planner<typename Motor::Modes>::plan(from.phase, to_steps(target_percentage) - from.steps);
+      follow(from, target_percentage, segments);
+      return segments;
+    }
+
+    /**
+     * @brief Advance a state past a move planned earlier, as plan() did.
+     *
+     * For replaying plans without working them out again.
+     */
+    auto follow(AxisState& from, uint32_t target_percentage, const Plan& segments) const -> void {
+      using namespace Utils::literals;
+      if (target_percentage > 100_percent)
+        return;
+
+      from.steps = to_steps(target_percentage);
+      for (const auto segment : segments)
+        from.phase += segment.steps;
+    }
+
+    /**
+     * @brief Level the DIR pin needs for a planned move. Plans that don't
+     * move keep the current one.
+     */
+    auto dir_level(const Plan& segments) const -> Peripherals::GPIO::Level { return dir_level(segments, static_cast<Peripherals::GPIO::Level>(motor.heading())); }
+
+    /**
+     * @brief Same, with the DIR pin at current instead of where it is now.
+     */
+    static auto dir_level(const Plan& segments, Peripherals::GPIO::Level current) -> Peripherals::GPIO::Level {
+      const auto moving = std::find_if(segments.begin(), segments.end(), [](const Segment& segment) { return segment.steps != 0; });
+      return moving == segments.end() ? current : static_cast<Peripherals::GPIO::Level>(direction_of(moving->steps));
+    }
+
+    /**
+     * @brief Take note that the DIR pin was driven to level from outside,
+     * see Motor::assume_heading().
+     */
+    auto assume_dir_level(Peripherals::GPIO::Level level) -> void { motor.assume_heading(static_cast<typename Motor::Direction>(level)); }
+
+    /**
+     * @brief Shape every move from now on, see Shaper. Only the longest
+     * segment of each move is shaped, so the delay is paid once per move.
+     */
+    auto shape(const Shaper& with) -> void { shaper = with; }
+
+    /**
+     * @brief How long run() takes for a planned move, without running it.
+     * See Motor::timing().
+     */
+    auto timing(const Plan& segments, uint32_t rate_hz = 0) const -> SegmentTiming {
+      SegmentTiming total = { .duration_us = 0, .peak_rate = 0, .clamped = false, .error_ppm = 0 };
+      for (const auto& segment : segments) {
+        if (segment.steps == 0)
+          continue;
+
+        const auto part = Motor::timing(std::abs(segment.steps), segment.mode, shaper_for(segments, segment), rate_hz);
+        total.duration_us += part.duration_us;
+        total.peak_rate = std::max(total.peak_rate, part.peak_rate);
+        total.clamped |= part.clamped;
+        total.error_ppm = std::max(total.error_ppm, part.error_ppm);
+      }
+      return total;
+    }
+
+    /**
+     * @brief Run a move planned with plan().
+     *
+     * @param rate_hz Pulses per second for every segment, 0 for the
+     * motor's Feed-scaled default. See Motor::move().
+     */
+    auto run(const Plan& segments, uint32_t target_percentage, bool sync = false, uint32_t rate_hz = 0) -> void {
       Utils::println<Utils::Colors::GREEN>("Axis.move({}, {})", target_percentage, sync);
 
       using namespace Utils::literals;
-      if (target_percentage < 0 or target_percentage > 100_percent)
+      if (target_percentage > 100_percent)
         return Utils::println<Utils::Colors::YELLOW>("Can't go to this position");
 
-      const int32_t delta = static_cast<int32_t>(target_percentage) - static_cast<int32_t>(pos);
-      if (delta == 0)
-        return;
+      for (const auto& segment : segments) {
+        if (segment.steps == 0)
+          continue;
 
-      const auto dir = (delta > 0 ? Motor::Direction::COUNTER_CLOCKWISE : Motor::Direction::CLOCKWISE);
-      const auto steps = std::abs(delta) * steps_at_100percent / 100_percent;
+        motor.move(direction_of(segment.steps), std::abs(segment.steps), false, segment.mode, shaper_for(segments, segment), rate_hz);
+      }
 
-      motor.move(dir, steps);
       if (sync)
         motor.wait();
 
-      pos = target_percentage;
+      target = to_steps(target_percentage);
+    }
+
+    auto move(uint32_t target_percentage, bool sync = false, uint32_t rate_hz = 0) -> void {
+      auto from = state();
+      run(plan(from, target_percentage), target_percentage, sync, rate_hz);
     }
 
-    auto where() const -> uint16_t { return pos; }
+    /**
+     * @brief Where the carriage actually is right now, not where it was told to go.
+     *
+     * Follows the motor's live step counter, so it's valid mid-move and
+     * after a stop, and can be polled from any core without pausing motion.
+     */
+    auto where() const -> uint32_t {
+      if (steps_at_100percent == 0)
+        return 0;
+
+      return to_percentage(std::clamp<int32_t>(motor.position(), 0, steps_at_100percent));
+    }
+
+    /**
+     * @brief Live position in motor steps, see Motor::position().
+     */
+    auto steps() const -> int32_t { return motor.position(); }
+
+    /**
+     * @brief Worst step interrupt latency of the motor, see Motor::latency().
+     */
+    auto latency() const -> uint32_t { return motor.latency(); }
+
+    auto reset_latency() -> void { motor.reset_latency(); }
 
     auto wait() -> void { motor.wait(); }
 
-    auto stop() -> void { motor.stop(); }
+    auto stop() -> void {
+      motor.stop();
+      target = motor.position();
+    }
 
     auto calibrate() -> void {
       EndSensor::initialize();
@@ -52,16 +259,23 @@ namespace Robot {
       std::this_thread::sleep_for(250ms);
 
       static constexpr auto END_SENSOR_ACTIVE = (EndSensor::pull == Peripherals::GPIO::Pull::UP ? Peripherals::GPIO::Level::HIGH : Peripherals::GPIO::Level::LOW);
-      static constexpr auto CALIBRATION_STEP = 50;
+      // Homing runs in the coarsest mode, both because it's fastest and
+      // because it leaves the driver's indexer on the coarse step grid.
+      // Probes of 10 steps at HOMING_RATE check the endstop every 50 ms
+      // and overshoot it by 10 steps at most.
+      static constexpr auto CALIBRATION_STEP = 10 * stride<typename Motor::Modes>(Motor::COARSEST);
       do {
-        motor.move(Motor::Direction::COUNTER_CLOCKWISE, CALIBRATION_STEP, true);
+        motor.move(Motor::Direction::COUNTER_CLOCKWISE, CALIBRATION_STEP, true, Motor::COARSEST, UNSHAPED, HOMING_RATE);
       } while (EndSensor::read() == END_SENSOR_ACTIVE);
 
-      steps_at_100percent = 0;
+      uint32_t stroke = 0;
       do {
-        motor.move(Motor::Direction::CLOCKWISE, CALIBRATION_STEP, true);
-        steps_at_100percent += CALIBRATION_STEP;
+        motor.move(Motor::Direction::CLOCKWISE, CALIBRATION_STEP, true, Motor::COARSEST, UNSHAPED, HOMING_RATE);
+        stroke += CALIBRATION_STEP;
       } while (EndSensor::read() == END_SENSOR_ACTIVE);
+      motor.home();
+      set_stroke(stroke);
+      target = 0;
 
       Utils::println<Utils::Colors::RED>("steps_at_100percent: {}", steps_at_100percent);
       move(50_percent, true);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "driver/uart.h"
+#include "sdkconfig.h"
+
+namespace Robot::Console {
+  /**
+   * @brief Start reading commands from the console UART.
+   *
+   * One command per line, Marlin style:
+   *  - `M220 S<percent>` asks Feed for a new override,
+   *  - `M220` reports the override in effect and the one asked for.
+   *
+   * The reader is a task on the I/O core, so it has to be started
+   * before the heap is sealed. Only the receive side goes through the
+   * UART driver, the console keeps printing as before.
+   */
+  auto start(uart_port_t port = static_cast<uart_port_t>(CONFIG_ESP_CONSOLE_UART_NUM)) -> void;
+}  // namespace Robot::Console
@@ -0,0 +1,534 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <ranges>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "peripherals/GPIO.hpp"
+#include "robot/Path.hpp"
+#include "robot/Planner.hpp"
+#include "robot/Shaper.hpp"
+#include "robot/TrajectoryCache.hpp"
+#include "task/Config.h"
+#include "task/Query.h"
+#include "task/Static.hpp"
+#include "telemetry/Telemetry.hpp"
+#include "telemetry/Trace.hpp"
+#include "utils/Percentage.hpp"
+#include "utils/print.hpp"
+
+namespace Robot {
+  /**
+   * @brief Drives any number of axes in lockstep.
+   *
+   * Every operation fans out to all axes at once and joins before
+   * returning, so the axes always start each trajectory point together.
+   * The last axis runs on the calling thread while the others each get
+   * a statically allocated worker task, started on first use and only
+   * woken up afterwards, so steady-state motion never touches the heap.
+   *
+   * Planned trajectories are cached, so replaying a path skips planning
+   * and starts moving right away.
+   *
+   * @tparam Axes The axes, in the order their coordinates appear in a Position.
+   */
+  template <typename... Axes>
+  class Coordinator final {
+    static_assert(sizeof...(Axes) > 0, "A robot needs at least one axis!");
+
+   public:
+    static constexpr size_t AXES = sizeof...(Axes);
+
+    /// One target per axis, in Utils::Percentage of its stroke
+    using Position = std::array<uint32_t, AXES>;
+
+    /// What each axis has to run to reach one trajectory point
+    using PlannedPoint = std::array<Plan, AXES>;
+
+    /// Where the planner takes each axis to be, see plan_point()
+    using PlanState = std::array<AxisState, AXES>;
+
+    /// Bytes of planned segments kept around for replays
+    static constexpr size_t CACHE_BUDGET = 16 * 1024;
+
+    /// Outcome of a dry run, see estimate()
+    struct Estimate {
+      /// Whole trajectory, the return to the center included
+      uint64_t duration_us;
+      /// Longest single point
+      uint32_t longest_point_us;
+      /// Points run, the return to the center included
+      size_t points;
+      /// Fastest each axis steps, in finest steps per second
+      std::array<uint32_t, AXES> peak_rate;
+      /// Worst step rate quantization of each axis, see SegmentTiming
+      std::array<uint32_t, AXES> error_ppm;
+      /// Points with a target past the end of an axis, which stays put
+      size_t out_of_range;
+      /// Points with a pause too long for a motor to encode, cut short
+      size_t clamped;
+    };
+
+   private:
+    static constexpr size_t WORKER_STACK = 4096;
+
+    using Cache = TrajectoryCache<PlannedPoint, CACHE_BUDGET>;
+
+    // The DIR pins of all axes, switched together
+    using DirectionPort = Peripherals::GPIO::Port<Axes::DIR_PIN...>;
+    using Levels = std::array<Peripherals::GPIO::Level, AXES>;
+    static constexpr uint32_t DIR_SETUP_US = std::max({ Axes::DIR_SETUP_US... });
+
+    std::tuple<Axes...> axes;
+
+    // Workers report back here. Per instance, so independent robots
+    // never steal each other's releases.
+    StaticSemaphore_t axes_done_buffer;
+    SemaphoreHandle_t axes_done = xSemaphoreCreateCountingStatic(AXES, 0, &axes_done_buffer);
+
+    // One worker per axis but the last, and the job each one runs next
+    std::array<Task::Static<WORKER_STACK>, AXES - 1> workers;
+    std::array<void (*)(Coordinator&, void*), AXES> jobs = {};
+    void* job_fn = nullptr;
+
+    std::atomic<uint32_t> segments_done = 0;
+
+    Cache cache;
+
+    // One channel per producer keeps each ring single-producer: move()
+    // feeds the planner channel, whoever calls sample() feeds motion.
+    Telemetry::Channel planner;
+    Telemetry::Channel motion;
+
+    struct {
+      std::array<int32_t, AXES> steps = {};
+      uint32_t timestamp_us = 0;
+    } last_sample;
+
+    template <size_t I, typename FnType>
+    static auto invoke(Coordinator& self, void* fn) -> void {
+      (*static_cast<FnType*>(fn))(std::get<I>(self.axes), I);
+    }
+
+    template <size_t I>
+    static auto work(void* arg) -> void {
+      Coordinator& self = *static_cast<Coordinator*>(arg);
+
+      while (true) {
+        Task::Static<WORKER_STACK>::wait();
+        const Telemetry::Trace::Scope trace{ "axis", I };
+        self.jobs[I](self, self.job_fn);
+        xSemaphoreGive(self.axes_done);
+      }
+    }
+
+    /// Workers start with the core and priority of whoever first drives
+    /// the robot, which is what run_on() relies on.
+    auto start_workers() -> void {
+      [&]<size_t... I>(std::index_sequence<I...>) {
+        if (((workers[I].started()) and ...))
+          return;
+
+        const auto priority = Task::Query::this_thread::priority();
+        const auto core = Task::Query::this_thread::affinity();
+        (workers[I].start(work<I>, this, "axis", priority, core), ...);
+      }(std::make_index_sequence<AXES - 1>{});
+    }
+
+    template <size_t I, typename FnType>
+    auto dispatch(FnType& fn) -> void {
+      if constexpr (I + 1 == AXES) {
+        fn(std::get<I>(axes), I);
+      } else {
+        jobs[I] = invoke<I, FnType>;
+        workers[I].notify();
+      }
+    }
+
+    /// Run fn(axis, index) on every axis concurrently and wait for all of them
+    template <typename FnType>
+    auto fan_out(FnType&& fn) -> void {
+      start_workers();
+      job_fn = &fn;
+
+      [&]<size_t... I>(std::index_sequence<I...>) {
+        (dispatch<I, std::remove_reference_t<FnType>>(fn), ...);
+      }(std::make_index_sequence<AXES>{});
+
+      const Telemetry::Trace::Scope trace{ "join" };
+      for (size_t i = 0; i + 1 < AXES; ++i)
+        xSemaphoreTake(axes_done, portMAX_DELAY);
+    }
+
+    /// FNV-1a over the path and everything the plans depend on
+    auto fingerprint(const PlanState& from, std::span<const Position> trajectory) const -> uint64_t {
+      uint64_t hash = 0xcbf29ce484222325;
+      const auto mix = [&](const auto& value) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+        for (size_t i = 0; i < sizeof(value); ++i)
+          hash = (hash ^ bytes[i]) * 0x100000001b3;
+      };
+
+      [&]<size_t... I>(std::index_sequence<I...>) {
+        (mix(std::get<I>(axes).plan_inputs(from[I])), ...);
+      }(std::make_index_sequence<AXES>{});
+      for (const auto& pos : trajectory)
+        mix(pos);
+
+      return hash;
+    }
+
+    /// Plan every point of the trajectory and then the return to the
+    /// center, handing each to fn(index, point, target)
+    ///
+    /// @return Points planned.
+    template <IsPath<Position> PathType, typename FnType>
+    auto plan_each(PathType&& trajectory, FnType&& fn) const -> size_t {
+      auto state = plan_state();
+      size_t index = 0;
+      for (const Position& target : trajectory) {
+        fn(index, plan_point(state, target), target);
+        ++index;
+      }
+
+      fn(index, plan_point(state, CENTER), CENTER);
+      return index + 1;
+    }
+
+    /// Levels the DIR pins are driven to right now
+    auto headings() const -> Levels {
+      return std::apply([](const auto&... axis) { return Levels{ axis.dir_level({})... }; }, axes);
+    }
+
+    /// Levels the DIR pins need for a point, coming from current
+    static auto dir_levels(const PlannedPoint& point, const Levels& current) -> Levels {
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return Levels{ Axes::dir_level(point[I], current[I])... };
+      }(std::make_index_sequence<AXES>{});
+    }
+
+    /// Set every axis's direction in one write, then wait for the
+    /// slowest driver to take it before any axis steps
+    auto set_directions(const PlannedPoint& point) -> void {
+      using Peripherals::GPIO::Level;
+
+      const auto current = headings();
+      const auto levels = dir_levels(point, current);
+      if (levels == current)
+        return;
+
+      [&]<size_t... I>(std::index_sequence<I...>) {
+        DirectionPort::write(((levels[I] == Level::HIGH ? DirectionPort::bit(Axes::DIR_PIN) : 0) | ...));
+        esp_rom_delay_us(DIR_SETUP_US);
+        (std::get<I>(axes).assume_dir_level(levels[I]), ...);
+      }(std::make_index_sequence<AXES>{});
+    }
+
+    /// Run one planned point on all axes and wait for them
+    auto run(const PlannedPoint& point, const Position& target, uint32_t rate_hz = 0) -> void {
+      set_directions(point);
+      fan_out([&](auto& axis, size_t index) { axis.run(point[index], target[index], true, rate_hz); });
+    }
+
+   public:
+    /// Where move() returns to after every trajectory
+    static constexpr Position CENTER = [] {
+      using namespace Utils::literals;
+      Position center;
+      center.fill(50_percent);
+      return center;
+    }();
+
+    /**
+     * @param planner_channel Telemetry name for segment progress.
+     * @param motion_channel Telemetry name for axis samples.
+     *
+     * @note Give each robot distinct names (up to 8 characters) when
+     * running several, so their streams can be told apart.
+     */
+    explicit Coordinator(const char* planner_channel = "planner", const char* motion_channel = "motion") : planner(planner_channel), motion(motion_channel) {}
+
+    /**
+     * @brief Start fn(*this) on a thread of its own, pinned to a core.
+     *
+     * The axis workers start on the core of whoever first drives the
+     * robot, so they end up on that core too. Running each robot from its
+     * own core keeps their pipelines from competing for CPU time.
+     *
+     * @param core Core to pin the robot's pipeline to.
+     * @param name Name of the pipeline task.
+     * @param fn Job to run, called with this robot.
+     */
+    template <typename FnType>
+    auto run_on(int core, const char* name, FnType&& fn) -> std::thread {
+      Task::Config().pinned_to_core(core).with_name(name).done();
+      auto worker = std::thread{ [this, fn = std::forward<FnType>(fn)]() mutable { fn(*this); } };
+      Task::Config().done();
+
+      return worker;
+    }
+
+    auto calibrate() -> void {
+      fan_out([](auto& axis, size_t index) {
+        axis.calibrate();
+        Utils::println<Utils::Colors::CYAN>("Axis {} calibrated", index);
+      });
+    }
+
+    /**
+     * @brief Run through a trajectory, then return to the center.
+     *
+     * The first run of a path plans it into the cache, later ones replay
+     * the cached segments as long as the path, the calibration and the
+     * starting point are the same.
+     */
+    auto move(const std::span<const Position> trajectory) -> void {
+      auto state = plan_state();
+      const auto points = plan_cached(state, trajectory);
+      if (points.empty())
+        return move_uncached(trajectory);
+
+      for (size_t segment = 0; segment < points.size(); ++segment) {
+        const auto& target = segment < trajectory.size() ? trajectory[segment] : CENTER;
+        if (segment < trajectory.size())
+          planner.push(Telemetry::Kind::SEGMENT, 0, segment, trajectory.size() - segment - 1);
+
+        run(points[segment], target);
+        if (segment < trajectory.size())
+          segments_done.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * @brief Run through a path produced point by point, then return to
+     * the center.
+     *
+     * Takes any range of Positions, lazy ones included (see Path), and
+     * only ever holds the point being run, so memory use doesn't depend
+     * on the length of the path. Paths stored in memory go through the
+     * cached move() instead.
+     */
+    template <IsPath<Position> PathType>
+      requires(not std::convertible_to<PathType, std::span<const Position>>)
+    auto move(PathType&& trajectory) -> void {
+      move_uncached(std::forward<PathType>(trajectory));
+    }
+
+    /**
+     * @brief Same as move(), planning each point right before running it.
+     *
+     * For trajectories too long for the cache, or never stored at all.
+     */
+    template <IsPath<Position> PathType>
+    auto move_uncached(PathType&& trajectory) -> void {
+      auto state = plan_state();
+      int32_t segment = 0;
+      for (const Position& target : trajectory) {
+        // How many points are left is only known up front for sized ranges
+        int32_t queued = -1;
+        if constexpr (std::ranges::sized_range<PathType>)
+          queued = static_cast<int32_t>(std::ranges::size(trajectory)) - segment - 1;
+        planner.push(Telemetry::Kind::SEGMENT, 0, segment++, queued);
+
+        run(plan_point(state, target), target);
+        segments_done.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      run(plan_point(state, CENTER), CENTER);
+    }
+
+    /**
+     * @brief Planning state of the axes as they stand now.
+     */
+    auto plan_state() const -> PlanState {
+      return std::apply([](const auto&... axis) { return PlanState{ axis.state()... }; }, axes);
+    }
+
+    /**
+     * @brief Plan a single point and move state on to its target.
+     *
+     * For planning ahead of the motors on another task, see Pipeline.
+     * Carrying state from one call to the next plans a path exactly as
+     * move() would.
+     */
+    auto plan_point(PlanState& state, const Position& target) const -> PlannedPoint {
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        return PlannedPoint{ std::get<I>(axes).plan(state[I], target[I])... };
+      }(std::make_index_sequence<AXES>{});
+    }
+
+    /**
+     * @brief Plan a whole trajectory and the return to the center through
+     * the cache, and move state on to the center.
+     *
+     * A path already planned from the same state is replayed, anything
+     * else is planned into the cache first. Only the task that plans may
+     * call it, and the points are only good until its next call.
+     *
+     * @return One point per target and the return to the center, empty
+     * (state untouched) if the trajectory can never fit in the cache.
+     */
+    auto plan_cached(PlanState& state, const std::span<const Position> trajectory) -> std::span<const PlannedPoint> {
+      const auto key = fingerprint(state, trajectory);
+      if (const auto points = cache.find(key); not points.empty()) {
+        for (size_t index = 0; index < points.size(); ++index) {
+          const auto& target = index < trajectory.size() ? trajectory[index] : CENTER;
+          [&]<size_t... I>(std::index_sequence<I...>) {
+            (std::get<I>(axes).follow(state[I], target[I], points[index][I]), ...);
+          }(std::make_index_sequence<AXES>{});
+        }
+        return points;
+      }
+
+      const auto fresh = cache.insert(key, trajectory.size() + 1);
+      if (fresh.empty())
+        return {};
+
+      size_t index = 0;
+      for (const auto& target : trajectory)
+        fresh[index++] = plan_point(state, target);
+      fresh[index] = plan_point(state, CENTER);
+      return fresh;
+    }
+
+    /**
+     * @brief Run a point from plan_point() on all axes and wait for them.
+     *
+     * The axes must be where the point was planned from, so only one
+     * task may drive the robot while points are planned ahead.
+     *
+     * @param rate_hz Pulses per second for every axis, 0 for the Feed-scaled
+     * default. See Motor::move().
+     */
+    auto run_point(const PlannedPoint& point, const Position& target, uint32_t rate_hz = 0) -> void {
+      run(point, target, rate_hz);
+      segments_done.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Dry run of move(): how long a trajectory takes, the return
+     * to the center included, without moving anything.
+     *
+     * Plans with the same code as move() from the current state and times
+     * every segment through the motors' own shaping and encoding, which
+     * accounts for every pulse. Not modelled are the few µs the RMT takes
+     * between two chunks of a move (see Motor::timing()) and the software
+     * time between points (waking the workers, queueing the pulses), so
+     * real runs come out somewhat longer. The cache is left alone.
+     *
+     * @param trajectory Path to estimate. A single-pass range is used
+     * up, lazy paths from Path can be walked again by move().
+     * @param point_us Filled with the duration of each point, as far as
+     * it goes. Empty to skip.
+     * @param rate_hz Pulses per second the points would run at, as given
+     * to run_point(). 0 for the Feed-scaled default.
+     */
+    template <IsPath<Position> PathType = std::span<const Position>>
+    auto estimate(PathType&& trajectory, std::span<uint32_t> point_us = {}, uint32_t rate_hz = 0) const -> Estimate {
+      using namespace Utils::literals;
+
+      Estimate estimate = {};
+      auto heading = headings();
+
+      estimate.points = plan_each(std::forward<PathType>(trajectory), [&](size_t index, const PlannedPoint& point, const Position& target) {
+        const auto levels = dir_levels(point, heading);
+        uint32_t duration = levels == heading ? 0 : DIR_SETUP_US;
+        heading = levels;
+
+        // The point lasts as long as its slowest axis
+        const auto timings = [&]<size_t... I>(std::index_sequence<I...>) {
+          return std::array<SegmentTiming, AXES>{ std::get<I>(axes).timing(point[I], rate_hz)... };
+        }(std::make_index_sequence<AXES>{});
+
+        uint32_t slowest = 0;
+        bool clamped = false;
+        for (size_t axis = 0; axis < AXES; ++axis) {
+          slowest = std::max(slowest, timings[axis].duration_us);
+          estimate.peak_rate[axis] = std::max(estimate.peak_rate[axis], timings[axis].peak_rate);
+          estimate.error_ppm[axis] = std::max(estimate.error_ppm[axis], timings[axis].error_ppm);
+          clamped |= timings[axis].clamped;
+        }
+        duration += slowest;
+
+        estimate.duration_us += duration;
+        estimate.longest_point_us = std::max(estimate.longest_point_us, duration);
+        estimate.out_of_range += std::any_of(target.begin(), target.end(), [](uint32_t pos) { return pos > 100_percent; });
+        estimate.clamped += clamped;
+        if (index < point_us.size())
+          point_us[index] = duration;
+      });
+
+      return estimate;
+    }
+
+    /**
+     * @brief Run every move of one axis through an input shaper.
+     *
+     * @param axis Index of the axis, as in a Position.
+     * @param shaper Tuned to a resonance measured along that axis.
+     */
+    auto shape(size_t axis, const Shaper& shaper) -> void {
+      [&]<size_t... I>(std::index_sequence<I...>) {
+        ((I == axis ? std::get<I>(axes).shape(shaper) : void()), ...);
+      }(std::make_index_sequence<AXES>{});
+    }
+
+    /**
+     * @brief Hits, misses and memory use of the trajectory cache.
+     */
+    auto cache_stats() const -> typename Cache::Stats { return cache.stats(); }
+
+    /**
+     * @brief Trajectory points completed since start-up.
+     */
+    auto segments() const -> uint32_t { return segments_done.load(std::memory_order_relaxed); }
+
+    auto where() const -> Position {
+      return std::apply([](const auto&... axis) { return Position{ axis.where()... }; }, axes);
+    }
+
+    /**
+     * @brief Push the live position and velocity of every axis to telemetry.
+     *
+     * Only reads the lock-free step counters, so it can run at a few
+     * hundred Hz from a low priority task without touching motion.
+     * Call it from a single task only.
+     */
+    auto sample() -> void {
+      const auto now = Telemetry::now();
+      const auto elapsed = now - last_sample.timestamp_us;
+      const auto steps = std::apply([](const auto&... axis) { return std::array<int32_t, AXES>{ axis.steps()... }; }, axes);
+
+      for (uint8_t axis = 0; axis < AXES; ++axis) {
+        const auto velocity = elapsed == 0 ? 0 : static_cast<int32_t>(int64_t{ steps[axis] - last_sample.steps[axis] } * 1'000'000 / elapsed);
+        motion.push(Telemetry::Kind::AXIS, axis, steps[axis], velocity);
+      }
+
+      last_sample = { .steps = steps, .timestamp_us = now };
+    }
+
+    /**
+     * @brief Worst step interrupt latency over all axes, in µs.
+     */
+    auto latency() const -> uint32_t {
+      return std::apply([](const auto&... axis) { return std::max({ axis.latency()... }); }, axes);
+    }
+
+    auto reset_latency() -> void {
+      std::apply([](auto&... axis) { (axis.reset_latency(), ...); }, axes);
+    }
+
+    auto stop() -> void {
+      std::apply([](auto&... axis) { (axis.stop(), ...); }, axes);
+    }
+  };
+}  // namespace Robot
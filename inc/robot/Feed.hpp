@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace Robot {
+  /**
+   * @brief Feed-rate override, scaling the step rate of every motor.
+   *
+   * Motors read it whenever they encode a move, so a change takes effect
+   * from the next segment on and nothing planned has to be redone. The
+   * override ramps to a new value at SLEW percent per second instead of
+   * jumping to it, so the motors never change speed abruptly.
+   *
+   * Safe to set and read from any task, not from interrupts.
+   */
+  class Feed {
+   public:
+    static constexpr uint32_t MIN_PERCENT = 10;
+    static constexpr uint32_t MAX_PERCENT = 200;
+    /// Fastest the override moves towards a new value, in percent per second
+    static constexpr uint32_t SLEW = 100;
+
+   private:
+    struct Ramp {
+      uint32_t from;
+      uint32_t to;
+      int64_t since_us;
+    };
+
+    static inline portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    static inline Ramp ramp = { .from = 100, .to = 100, .since_us = 0 };
+
+    static auto at(const Ramp& state, int64_t now_us) -> uint32_t {
+      const auto moved = static_cast<uint64_t>(now_us - state.since_us) * SLEW / 1'000'000;
+      if (state.to > state.from)
+        return state.from + static_cast<uint32_t>(std::min<uint64_t>(moved, state.to - state.from));
+      return state.from - static_cast<uint32_t>(std::min<uint64_t>(moved, state.from - state.to));
+    }
+
+   public:
+    /**
+     * @brief Ask for a new override, clamped to MIN_PERCENT..MAX_PERCENT.
+     * The ramp towards it starts from wherever the current one got to.
+     */
+    static auto set(uint32_t percent) -> void {
+      const auto now = esp_timer_get_time();
+      taskENTER_CRITICAL(&lock);
+      ramp = { .from = at(ramp, now), .to = std::clamp(percent, MIN_PERCENT, MAX_PERCENT), .since_us = now };
+      taskEXIT_CRITICAL(&lock);
+    }
+
+    /**
+     * @brief Override last asked for, in percent.
+     */
+    static auto requested() -> uint32_t {
+      taskENTER_CRITICAL(&lock);
+      const auto to = ramp.to;
+      taskEXIT_CRITICAL(&lock);
+      return to;
+    }
+
+    /**
+     * @brief Override in effect right now, in percent.
+     */
+    static auto current() -> uint32_t {
+      const auto now = esp_timer_get_time();
+      taskENTER_CRITICAL(&lock);
+      const auto percent = at(ramp, now);
+      taskEXIT_CRITICAL(&lock);
+      return percent;
+    }
+  };
+}  // namespace Robot
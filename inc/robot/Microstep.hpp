@@ -0,0 +1,98 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+
+#include "peripherals/GPIO.hpp"
+
+namespace Robot {
+  /**
+   * @brief Step resolution, as the number of pulses per full step.
+   */
+  enum class Microstep : uint8_t {
+    FULL = 1,
+    HALF = 2,
+    QUARTER = 4,
+    EIGHTH = 8,
+    SIXTEENTH = 16,
+    THIRTY_SECOND = 32,
+  };
+
+  /**
+   * @brief Mode pins wired to fixed levels on the board.
+   *
+   * The firmware can't change anything, so every pulse is one step of
+   * whatever the board was built for and there's nothing to plan.
+   */
+  struct Hardwired {
+    static constexpr auto FINEST = Microstep::FULL;
+    static constexpr auto COARSEST = Microstep::FULL;
+
+    static auto initialize() -> void {}
+    static auto set(Microstep) -> void {}
+  };
+
+  /**
+   * @brief DRV8825 M0/M1/M2 mode pins driven from GPIOs.
+   *
+   * @tparam m0 GPIO pin for M0.
+   * @tparam m1 GPIO pin for M1.
+   * @tparam m2 GPIO pin for M2.
+   */
+  template <uint8_t m0, uint8_t m1, uint8_t m2>
+  struct DRV8825 {
+    static constexpr auto FINEST = Microstep::THIRTY_SECOND;
+    static constexpr auto COARSEST = Microstep::FULL;
+
+   private:
+    using M0 = Peripherals::GPIO::Output<m0>;
+    using M1 = Peripherals::GPIO::Output<m1>;
+    using M2 = Peripherals::GPIO::Output<m2>;
+
+    static auto level(uint8_t bits, uint8_t bit) -> Peripherals::GPIO::Level { return static_cast<Peripherals::GPIO::Level>((bits >> bit) & 1); }
+
+   public:
+    static auto initialize() -> void {
+      M0::initialize();
+      M1::initialize();
+      M2::initialize();
+      set(COARSEST);
+    }
+
+    /**
+     * @brief Select the step resolution. Only call it while the motor is idle.
+     */
+    static auto set(Microstep mode) -> void {
+      // Datasheet table 3, as M2 M1 M0
+      uint8_t bits = 0b000;
+      switch (mode) {
+        case Microstep::FULL: bits = 0b000; break;
+        case Microstep::HALF: bits = 0b001; break;
+        case Microstep::QUARTER: bits = 0b010; break;
+        case Microstep::EIGHTH: bits = 0b011; break;
+        case Microstep::SIXTEENTH: bits = 0b100; break;
+        case Microstep::THIRTY_SECOND: bits = 0b101; break;
+      }
+
+      M0::set(level(bits, 0));
+      M1::set(level(bits, 1));
+      M2::set(level(bits, 2));
+    }
+  };
+
+  template <typename T>
+  concept IsModeSelector = requires(Microstep mode) {
+    { T::FINEST } -> std::convertible_to<Microstep>;
+    { T::COARSEST } -> std::convertible_to<Microstep>;
+    { T::initialize() } -> std::same_as<void>;
+    { T::set(mode) } -> std::same_as<void>;
+  };
+
+  /**
+   * @brief Finest-resolution steps covered by one pulse in the given mode.
+   */
+  template <IsModeSelector Modes>
+  constexpr auto stride(Microstep mode) -> uint32_t {
+    return static_cast<uint32_t>(Modes::FINEST) / static_cast<uint32_t>(mode);
+  }
+}  // namespace Robot
@@ -1,12 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdlib>
+#include <span>
 #include <vector>
 
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
 #include "peripherals/GPIO.hpp"
 #include "peripherals/RMT.hpp"
+#include "robot/Feed.hpp"
+#include "robot/Microstep.hpp"
+#include "robot/Planner.hpp"
+#include "robot/Shaper.hpp"
 #include "soc/clk_tree_defs.h"
+#include "telemetry/Trace.hpp"
 #include "utils/Frequency.hpp"
+#include "utils/Realtime.hpp"
 #include "utils/print.hpp"
 
 namespace Robot {
@@ -17,74 +29,487 @@ namespace Robot {
   /**
    * @brief Stepper Motor Driver using RMT (ESP-IDF v5.x).
    *
+   * Positions and step counts are always in steps of the finest mode
+   * the driver supports, so they stay consistent whatever resolution
+   * each move is made at.
+   *
    * @tparam StepPin GPIO pin for Step signal.
    * @tparam DirPin GPIO pin for Direction signal.
+   * @tparam ModePins Microstep mode pins, Hardwired if the board fixes them.
+   *
+   * @note The RMT interrupt reads the pulse buffer and the counters in
+   * here, so motors must live in internal RAM (static or global objects
+   * do) for it to keep running while the flash is busy.
    */
-  template <uint8_t step_pin, uint8_t dir_pin>
+  template <uint8_t step_pin, uint8_t dir_pin, IsModeSelector ModePins = Hardwired>
   class Motor {
    public:
+    using Modes = ModePins;
+
     enum class Direction {
       CLOCKWISE = static_cast<bool>(Peripherals::GPIO::Level::HIGH),
       COUNTER_CLOCKWISE = static_cast<bool>(Peripherals::GPIO::Level::LOW),
     };
 
+    /// GPIO of the DIR signal, for driving several motors through a Port
+    static constexpr uint8_t DIR_PIN = dir_pin;
+
+    /// DIR has to be stable this long before the next STEP edge. The
+    /// DRV8825 asks for 650 ns (datasheet, timing requirements), rounded
+    /// up to what esp_rom_delay_us() can wait.
+    static constexpr uint32_t DIR_SETUP_US = 1;
+
+    /// Slowest and fastest step rates move() takes, in pulses per second
+    static constexpr auto MIN_RATE = 1_Hz;
+    static constexpr auto MAX_RATE = 250_kHz;
+
    private:
     using DirectionPin = Peripherals::GPIO::Output<dir_pin>;
+    // Ticks of 100 ns, so that even at MAX_RATE a period is 40 ticks and
+    // rounding it to a whole tick is off by 1.25% at worst
     static constexpr auto RMT_FREQ = 10_MHz;
+    static constexpr uint32_t TICKS_PER_US = RMT_FREQ / 1'000'000;
+    // Step rate at a 100% feed, in pulses per second of whatever mode a
+    // move runs in
     static constexpr auto SPEED = 500_Hz;
+    // Fastest the override may drive the motor, in finest steps per
+    // second: full steps at 150% of SPEED, about what the motors pull
+    // at the DRV8825's current limit without stalling. Coarse moves run
+    // into it above a 150% feed, fine ones never get near it.
+    static constexpr uint32_t MAX_VELOCITY = SPEED * 3 / 2 * Robot::stride<Modes>(Microstep::FULL);
+    // Every pulse is low until its rising edge, then high for the 1.9 µs
+    // the DRV8825 asks for (datasheet, timing requirements), rounded up.
+    static constexpr uint32_t HIGH_TICKS = 2 * TICKS_PER_US;
+    // Each half of a symbol holds 15 bits, about 3.3 ms. Longer low times
+    // are split over symbols that stay low on both halves.
+    static constexpr uint32_t MAX_HALF = 0x7FFF;
+    static constexpr uint32_t MAX_INTERVAL = RMT_FREQ / MIN_RATE;
+
+    /// Closest interval between two pulses the encoding can produce
+    static constexpr auto encodable(uint32_t interval) -> uint32_t { return std::clamp(interval, HIGH_TICKS + 1, MAX_INTERVAL); }
+
+    /// Symbol halves the low time of an interval is spread over. Always
+    /// odd, so that they pair up into all-low symbols but for the last,
+    /// which shares its symbol with the pulse.
+    static constexpr auto halves(uint32_t interval) -> uint32_t { return ((encodable(interval) - HIGH_TICKS + MAX_HALF - 1) / MAX_HALF) | 1; }
+
+    /// Symbols encode() takes for an interval
+    static constexpr auto symbols(uint32_t interval) -> size_t { return (halves(interval) + 1) / 2; }
+
+    // Symbols are queued by reference, so every phase of a shaped move
+    // gets a buffer of its own, reused for each of its chunks. It starts
+    // with the phase's lead and the following chunks skip it, so it has
+    // to hold the longest lead plus at least one period.
+    static constexpr size_t CHUNK = 320;
+    static_assert(2 * symbols(MAX_INTERVAL) <= CHUNK, "MIN_RATE is too slow for the pulse buffers");
+    // Period, pulses and length in ticks of every queued chunk, by chunk
+    // number. Must exceed the RMT queue depth so that queuing never
+    // overwrites a pending one.
+    static constexpr size_t PERIODS = 16;
 
     Peripherals::RMT<step_pin, RMT_FREQ> rmt;
-    std::array<rmt_symbol_word_t, 1000> pulse_buffer;
+    std::array<std::array<rmt_symbol_word_t, CHUNK>, Shaper::MAX_PHASES> pulse_buffers;
+    std::array<std::atomic<uint32_t>, PERIODS> chunk_periods = {};
+    std::array<std::atomic<uint32_t>, PERIODS> chunk_pulses = {};
+    std::array<std::atomic<uint32_t>, PERIODS> chunk_ticks = {};
+    uint32_t chunks_queued = 0;
+    std::atomic<uint32_t> chunks_done = 0;
+
+    // Live position, written by the RMT ISR and read from any core.
+    //
+    // The values only make sense together, so writers bump `seq`
+    // to an odd value while updating them and back to even when done
+    // (a seqlock). Readers retry instead of locking. There's only ever
+    // one writer: the ISR while chunks are in flight, the owning task
+    // while the channel is idle. stop() writes mid-move, so it silences
+    // the ISR first: it raises `stopping`, then waits for `in_isr` to
+    // drop. Both are sequentially consistent, so either the ISR sees the
+    // flag and leaves, or stop() sees it running and waits it out.
+    std::atomic<uint32_t> seq = 0;
+    std::atomic<bool> stopping = false;
+    std::atomic<bool> in_isr = false;
+    std::atomic<int32_t> steps_done = 0;
+    std::atomic<int32_t> steps_target = 0;
+    std::atomic<uint32_t> chunk_start_us = 0;
+    // In ticks
+    std::atomic<uint32_t> chunk_period = RMT_FREQ / SPEED;
+    // Pulses of the chunk in flight
+    std::atomic<uint32_t> chunk_size = 0;
+    // Finest steps per pulse of the move in progress
+    std::atomic<int32_t> step_stride = 1;
+    // Worst delay between a chunk's last pulse and its interrupt
+    std::atomic<uint32_t> worst_latency_us = 0;
+
+    // Steps taken before the last home(). The driver's indexer starts
+    // at its home state on power-up, so origin + position is where the
+    // indexer is, which is what decides if a coarse mode lines up.
+    int32_t origin = 0;
+    Microstep mode = Modes::COARSEST;
+    Direction direction = Direction::CLOCKWISE;
+
+    REALTIME_ATTR static auto now_us() -> uint32_t { return static_cast<uint32_t>(esp_timer_get_time()); }
+
+    /// Step rate a move asks for: rate_hz within MIN_RATE..MAX_RATE, or
+    /// for 0 SPEED as scaled by the Feed override right now, held to
+    /// MAX_VELOCITY at a stride of finest steps per pulse
+    static auto requested(uint32_t rate_hz, uint32_t stride) -> uint32_t {
+      if (rate_hz == 0)
+        return std::min<uint32_t>(SPEED * Feed::current() / 100, MAX_VELOCITY / stride);
+      return std::clamp<uint32_t>(rate_hz, MIN_RATE, MAX_RATE);
+    }
+
+    /// Ticks between pulses at a rate, to the nearest tick
+    static constexpr auto period_of(uint32_t rate) -> uint32_t { return (RMT_FREQ + rate / 2) / rate; }
+
+    /// How far a period in ticks is off a rate, in parts per million
+    static constexpr auto error_ppm(uint32_t period, uint32_t rate) -> uint32_t {
+      const auto off = static_cast<int64_t>(period) * rate - RMT_FREQ;
+      return static_cast<uint32_t>((off < 0 ? -off : off) * 1'000'000 / RMT_FREQ);
+    }
+
+    /**
+     * @brief Write the symbols of a pulse coming interval ticks after the
+     * previous one, spreading its low time evenly over halves().
+     *
+     * @return Symbols written, symbols(interval) of them.
+     */
+    static auto encode(uint32_t interval, std::span<rmt_symbol_word_t> out) -> size_t {
+      const auto count = halves(interval);
+      const auto low = encodable(interval) - HIGH_TICKS;
+      // The first low % count halves take a tick more
+      const auto half = [&](uint32_t i) { return static_cast<uint16_t>(low / count + (i < low % count ? 1 : 0)); };
+
+      const auto fillers = count / 2;
+      for (uint32_t i = 0; i < fillers; ++i)
+        out[i] = { .duration0 = half(2 * i), .level0 = 0, .duration1 = half(2 * i + 1), .level1 = 0 };
+      out[fillers] = { .duration0 = half(count - 1), .level0 = 0, .duration1 = HIGH_TICKS, .level1 = 1 };
+      return fillers + 1;
+    }
+
+    /// Queue a chunk of pulses, all but the first one period ticks apart.
+    /// Never waits for it: the ISR ending a chunk reads its successor's
+    /// slot, so that one has to be queued by then.
+    auto queue(std::span<rmt_symbol_word_t> chunk, size_t pulses, uint32_t period, uint32_t ticks) -> void {
+      const auto slot = chunks_queued++ % PERIODS;
+      chunk_periods[slot].store(period, std::memory_order_relaxed);
+      chunk_pulses[slot].store(pulses, std::memory_order_relaxed);
+      chunk_ticks[slot].store(ticks, std::memory_order_relaxed);
+      rmt.transmit(chunk);
+    }
+
+    template <typename FnType>
+    auto publish(FnType&& update) -> void {
+      seq.fetch_add(1);
+      update();
+      seq.fetch_add(1);
+    }
+
+    // Everything here has to be in IRAM (see utils/Realtime.hpp), so no
+    // std::min or lambdas, -Og may leave them as calls into flash.
+    REALTIME_ATTR static auto on_chunk_done(rmt_channel_handle_t, const rmt_tx_done_event_data_t*, void* arg) -> bool {
+      Motor* self = static_cast<Motor*>(arg);
+      const auto now = now_us();
+      const Telemetry::Trace::Scope trace{ "rmt isr", step_pin };
+
+      self->in_isr.store(true);
+      if (self->stopping.load()) {
+        self->in_isr.store(false);
+        return false;
+      }
+
+      // Slow pulses take several symbols, so they're counted from what
+      // was queued rather than from the symbols sent
+      const auto finished = self->chunks_done.load(std::memory_order_relaxed);
+      const auto done = self->steps_done.load(std::memory_order_relaxed);
+      const auto remaining = self->steps_target.load(std::memory_order_relaxed) - done;
+      const auto distance = remaining >= 0 ? remaining : -remaining;
+      const auto pulses = static_cast<int32_t>(self->chunk_pulses[finished % PERIODS].load(std::memory_order_relaxed));
+      const auto travel = pulses * self->step_stride.load(std::memory_order_relaxed);
+      const auto steps = travel < distance ? travel : distance;
+
+      // Chunks queue back to back, so after a late interrupt the next one
+      // looks early rather than on time. That only ever understates, the
+      // worst case still shows. A phase's first chunk starts with its
+      // lead, which the queued length includes.
+      const auto sent_us = self->chunk_ticks[finished % PERIODS].load(std::memory_order_relaxed) / TICKS_PER_US;
+      const auto late = static_cast<int32_t>(now - self->chunk_start_us.load(std::memory_order_relaxed) - sent_us);
+
+      // Chunks complete in order, the next one starts right away
+      const auto next = finished + 1;
+      self->chunks_done.store(next, std::memory_order_relaxed);
+      if (late > 0 and static_cast<uint32_t>(late) > self->worst_latency_us.load(std::memory_order_relaxed))
+        self->worst_latency_us.store(late, std::memory_order_relaxed);
+
+      // Same as publish()
+      self->seq.fetch_add(1);
+      self->steps_done.store(remaining >= 0 ? done + steps : done - steps);
+      self->chunk_start_us.store(now);
+      self->chunk_period.store(self->chunk_periods[next % PERIODS].load(std::memory_order_relaxed));
+      self->chunk_size.store(self->chunk_pulses[next % PERIODS].load(std::memory_order_relaxed));
+      self->seq.fetch_add(1);
+      self->in_isr.store(false);
+
+      if (steps == distance)
+        Telemetry::Trace::instant("segment done", step_pin);
+
+      return false;
+    }
 
    public:
+    /// Finest resolution this driver can step at
+    static constexpr auto FINEST = Modes::FINEST;
+    /// Coarsest, and therefore fastest, resolution
+    static constexpr auto COARSEST = Modes::COARSEST;
+
     Motor() {
       DirectionPin::initialize();
-
-      static constexpr auto HALF_PERIOD = RMT_FREQ / (SPEED * 2);
-      static constexpr auto FRAME = rmt_symbol_word_t{
-        .duration0 = HALF_PERIOD,
-        .level0 = 1,
-        .duration1 = HALF_PERIOD,
-        .level1 = 0,
-      };
-      std::fill(pulse_buffer.begin(), pulse_buffer.end(), FRAME);
+      DirectionPin::set(static_cast<Peripherals::GPIO::Level>(direction));
+      Modes::initialize();
+      rmt.on_done(on_chunk_done, this);
     }
 
     /**
      * @brief Move the motor.
      *
      * @param dir Direction to spin the motor in.
-     * @param steps Number of steps.
+     * @param steps Number of finest-resolution steps, rounded down to
+     * a whole number of pulses in the selected mode.
+     * @param sync Block until the move is done.
+     * @param resolution Microstep mode to pulse in. Every pulse takes
+     * the same time, so coarser modes cover distance proportionally faster.
+     * @param shaper Input shaper to run the move through, none by default.
+     * @param rate_hz Pulses per second, from MIN_RATE to MAX_RATE. 0 for
+     * the default rate, scaled by the Feed override as it stands when the
+     * move is encoded. Pulses are timed to the nearest 100 ns, timing()
+     * tells how far that is off.
      */
-    auto move(Direction dir, size_t steps, bool sync = false) -> void {
-      if (steps == 0)
+    auto move(Direction dir, size_t steps, bool sync = false, Microstep resolution = Modes::FINEST, const Shaper& shaper = {}, uint32_t rate_hz = 0) -> void {
+      const auto stride = Robot::stride<Modes>(resolution);
+      const auto pulses = steps / stride;
+      if (pulses == 0)
         return;
 
-      DirectionPin::set(static_cast<Peripherals::GPIO::Level>(dir));
+      const auto profile = shaper.shape(pulses, period_of(requested(rate_hz, stride)), TICKS_PER_US);
+
+      Telemetry::Trace::instant("segment enqueue", step_pin);
       rmt.join();
+      if (dir != direction) {
+        DirectionPin::set(static_cast<Peripherals::GPIO::Level>(dir));
+        direction = dir;
+        esp_rom_delay_us(DIR_SETUP_US);
+      }
 
-      while (steps > 0) {
-        const auto count = std::min(pulse_buffer.size(), steps);
-        rmt.transmit({ pulse_buffer.data(), count }, sync);
-        if (sync)
-          wait();
-        steps -= count;
+      if (resolution != mode) {
+        Modes::set(resolution);
+        mode = resolution;
       }
+
+      // The channel is idle, whatever a stop() cut off is never coming
+      chunks_done.store(chunks_queued);
+
+      for (size_t phase = 0; phase < profile.count; ++phase) {
+        const auto& part = profile.phases[phase];
+        const auto period = encodable(part.period);
+        const std::span<rmt_symbol_word_t> buffer = pulse_buffers[phase];
+
+        // The lead, then as many periods as fit and the phase needs, all
+        // copies of the first one
+        const auto lead = encode(part.lead, buffer);
+        const auto each = symbols(period);
+        const auto fit = std::min<size_t>((buffer.size() - lead) / each, part.pulses);
+        encode(period, buffer.subspan(lead));
+        for (size_t i = 1; i < fit; ++i)
+          std::copy_n(buffer.begin() + lead, each, buffer.begin() + lead + i * each);
+
+        auto count = 1 + std::min<size_t>(fit, part.pulses - 1);
+        if (phase == 0) {
+          // The channel is idle, so the first chunk goes out right away
+          publish([&]() {
+            const auto travel = static_cast<int32_t>(pulses * stride);
+            steps_target.store(steps_done.load() + (dir == Direction::COUNTER_CLOCKWISE ? travel : -travel));
+            step_stride.store(stride);
+            chunk_start_us.store(now_us());
+            chunk_period.store(period);
+            chunk_size.store(count);
+          });
+          Telemetry::Trace::instant("segment start", step_pin);
+        }
+        queue(buffer.first(lead + (count - 1) * each), count, period, encodable(part.lead) + (count - 1) * period);
+        for (auto left = part.pulses - count; left > 0; left -= count) {
+          count = std::min<size_t>(fit, left);
+          queue(buffer.subspan(lead, count * each), count, period, count * period);
+        }
+      }
+
+      if (sync)
+        rmt.join();
+    }
+
+    /**
+     * @brief How long move() takes to send a move, without sending it.
+     *
+     * Goes through the same shaping and encoding as move(), at the Feed
+     * override in effect for the default rate, so it counts every symbol
+     * of the pulse train to the µs. It leaves out the gap between
+     * chunks: each one is a transaction of its own, started by the
+     * driver from the previous one's interrupt, a few µs apiece.
+     */
+    static auto timing(size_t steps, Microstep resolution, const Shaper& shaper = {}, uint32_t rate_hz = 0) -> SegmentTiming {
+      const auto stride = Robot::stride<Modes>(resolution);
+      const auto pulses = steps / stride;
+      SegmentTiming timing = { .duration_us = 0, .peak_rate = 0, .clamped = false, .error_ppm = 0 };
+      if (pulses == 0)
+        return timing;
+
+      const auto rate = requested(rate_hz, stride);
+      const auto base = period_of(rate);
+
+      uint64_t ticks = 0;
+      uint32_t shortest = MAX_INTERVAL;
+      for (const auto& part : shaper.shape(pulses, base, TICKS_PER_US)) {
+        const auto lead = encodable(part.lead);
+        const auto period = encodable(part.period);
+        ticks += lead + uint64_t{ part.pulses - 1 } * period;
+        shortest = std::min({ shortest, lead, part.pulses > 1 ? period : lead });
+        timing.clamped |= lead != part.lead or (part.pulses > 1 and period != part.period);
+      }
+
+      // Over an hour only at the slowest rates, where it saturates
+      timing.duration_us = static_cast<uint32_t>(std::min<uint64_t>((ticks + TICKS_PER_US / 2) / TICKS_PER_US, UINT32_MAX));
+      timing.peak_rate = static_cast<uint32_t>(uint64_t{ stride } * RMT_FREQ / shortest);
+      timing.error_ppm = error_ppm(base, rate);
+      return timing;
     }
 
+    /**
+     * @brief Direction the DIR pin is currently driven to.
+     */
+    auto heading() const -> Direction { return direction; }
+
+    /**
+     * @brief Take note that the DIR pin was driven from outside, so that
+     * move() doesn't drive it again.
+     *
+     * For drivers switching many motors' pins in a single write, who are
+     * then also responsible for waiting DIR_SETUP_US. Only call it while
+     * the motor is idle.
+     */
+    auto assume_heading(Direction dir) -> void { direction = dir; }
+
     /**
      * @brief Blocks until the motor finishes the current move.
      */
     auto wait() -> void { rmt.join(); }
 
+    /**
+     * @brief Instantaneous position, in finest steps since the last home().
+     *
+     * Steps are counted positive towards COUNTER_CLOCKWISE. Completed
+     * chunks are confirmed by the RMT ISR, the chunk currently being
+     * transmitted is interpolated from its start time, which is exact
+     * since the RMT clocks the pulses out on its own.
+     *
+     * Lock-free and safe to call from any core while the motor moves.
+     */
+    auto position() const -> int32_t {
+      uint32_t version;
+      int32_t done, target, stride;
+      uint32_t started, period, size;
+
+      do {
+        version = seq.load();
+        done = steps_done.load();
+        target = steps_target.load();
+        stride = step_stride.load();
+        started = chunk_start_us.load();
+        period = chunk_period.load();
+        size = chunk_size.load();
+      } while ((version & 1) or version != seq.load());
+
+      // Slots start out empty, and a chunk ending before its successor
+      // was queued would publish one. Nothing to interpolate then.
+      if (done == target or period == 0)
+        return done;
+
+      // A late interrupt leaves the clock running past the chunk's end,
+      // which never sends more than its own pulses
+      const int64_t elapsed = now_us() - started;
+      const auto pulsed = std::min<int64_t>(elapsed * TICKS_PER_US / period, size);
+      const auto in_flight = std::min<int64_t>(pulsed * stride, std::abs(target - done));
+
+      return done + static_cast<int32_t>(target > done ? in_flight : -in_flight);
+    }
+
+    /**
+     * @brief Worst delay between the end of a chunk of pulses and its
+     * transmit-done interrupt since the last reset_latency(), in µs.
+     */
+    auto latency() const -> uint32_t { return worst_latency_us.load(std::memory_order_relaxed); }
+
+    auto reset_latency() -> void { worst_latency_us.store(0, std::memory_order_relaxed); }
+
+    /**
+     * @brief Where the commanded moves end up, counted from the driver's
+     * power-up state rather than from home(). Used to keep coarse moves
+     * aligned to the driver's step table.
+     */
+    auto phase() const -> int32_t { return origin + steps_target.load(); }
+
+    /**
+     * @brief Declare the current position as step zero.
+     */
+    auto home() -> void {
+      origin += steps_target.load();
+      publish([&]() {
+        steps_done.store(0);
+        steps_target.store(0);
+      });
+    }
+
     /**
      * @brief Emergency stop.
+     *
+     * The position is frozen at wherever the pulses were cut off, so
+     * position() stays correct afterwards.
      */
-    auto stop() -> void { rmt.stop(); }
+    auto stop() -> void {
+      stopping.store(true);
+      while (in_isr.load())
+        ;
+
+      const auto here = position();
+      rmt.stop();
+
+      publish([&]() {
+        steps_done.store(here);
+        steps_target.store(here);
+      });
+      stopping.store(false);
+    }
   };
 
+  /**
+   * @brief Anything that steps a motor the way Motor does, so that Axis
+   * can run on either step backend (Motor, PwmMotor).
+   */
   template <typename T>
-  concept IsMotor = requires(T copy) {
-    { Motor{ copy } } -> std::same_as<T>;
+  concept IsMotor = IsModeSelector<typename T::Modes> and requires(T motor, const T& view, typename T::Direction dir, size_t steps, Microstep mode, const Shaper& shaper, uint32_t rate) {
+    { T::DIR_PIN } -> std::convertible_to<uint8_t>;
+    { T::DIR_SETUP_US } -> std::convertible_to<uint32_t>;
+    { T::MIN_RATE } -> std::convertible_to<uint32_t>;
+    { T::MAX_RATE } -> std::convertible_to<uint32_t>;
+    { T::FINEST } -> std::convertible_to<Microstep>;
+    { T::COARSEST } -> std::convertible_to<Microstep>;
+    { motor.move(dir, steps, true, mode, shaper, rate) } -> std::same_as<void>;
+    { T::timing(steps, mode, shaper, rate) } -> std::same_as<SegmentTiming>;
+    { view.heading() } -> std::same_as<typename T::Direction>;
+    { motor.assume_heading(dir) } -> std::same_as<void>;
+    { motor.wait() } -> std::same_as<void>;
+    { view.position() } -> std::same_as<int32_t>;
+    { view.latency() } -> std::same_as<uint32_t>;
+    { motor.reset_latency() } -> std::same_as<void>;
+    { view.phase() } -> std::same_as<int32_t>;
+    { motor.home() } -> std::same_as<void>;
+    { motor.stop() } -> std::same_as<void>;
   };
 }  // namespace Robot
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <ranges>
+
+namespace Robot {
+  /**
+   * @brief Anything a robot can follow: a range of points, walked once
+   * from the front.
+   *
+   * Arrays and spans of Positions qualify, and so do lazy views that
+   * compute every point as it's asked for, like the ones in Path.
+   */
+  template <typename R, typename Position>
+  concept IsPath = std::ranges::input_range<R> and std::convertible_to<std::ranges::range_reference_t<R>, Position>;
+
+  /**
+   * @brief Lazy trajectories.
+   *
+   * Each one is a view computing its points on the fly, so it takes the
+   * same few bytes however many points it has. They can be walked any
+   * number of times, e.g. once by estimate() and once by move().
+   *
+   * Coordinates are in Utils::Percentage of each axis's stroke. Axes a
+   * path doesn't move stay at the coordinate of its center or start.
+   */
+  namespace Path {
+    /**
+     * @brief Points evenly spaced along a straight line.
+     *
+     * @param from Where the line starts, left out since the robot is
+     * normally there already.
+     * @param to Where the line ends, the last point.
+     * @param points Number of points.
+     */
+    template <size_t N>
+    auto line(std::array<uint32_t, N> from, std::array<uint32_t, N> to, size_t points) {
+      return std::views::iota(size_t{ 1 }, points + 1) | std::views::transform([=](size_t i) {
+               std::array<uint32_t, N> point;
+               for (size_t axis = 0; axis < N; ++axis) {
+                 const auto travel = int64_t{ to[axis] } - from[axis];
+                 point[axis] = static_cast<uint32_t>(from[axis] + travel * static_cast<int64_t>(i) / static_cast<int64_t>(points));
+               }
+               return point;
+             });
+    }
+
+    /**
+     * @brief Points evenly spaced around a circle, starting at angle 0.
+     *
+     * @param center Center of the circle.
+     * @param radius Radius, at most the center's distance to either end
+     * of both axes.
+     * @param points Number of points, the first one isn't repeated at
+     * the end.
+     * @param u,v The axes spanning the circle's plane.
+     */
+    template <size_t N>
+    auto circle(std::array<uint32_t, N> center, uint32_t radius, size_t points, size_t u = 0, size_t v = 1) {
+      return std::views::iota(size_t{ 0 }, points) | std::views::transform([=](size_t i) {
+               const float angle = (2.0f * std::numbers::pi_v<float> * i) / points;
+               auto point = center;
+               point[u] = static_cast<uint32_t>(center[u] + radius * std::cos(angle));
+               point[v] = static_cast<uint32_t>(center[v] + radius * std::sin(angle));
+               return point;
+             });
+    }
+
+    /**
+     * @brief Points evenly spaced in angle along a spiral whose radius
+     * grows (or shrinks) steadily from one value to another.
+     *
+     * @param center Center of the spiral.
+     * @param from_radius Radius of the first point.
+     * @param to_radius Radius of the last point.
+     * @param turns Full turns from the first point to the last.
+     * @param points Number of points, at least 2.
+     * @param u,v The axes spanning the spiral's plane.
+     */
+    template <size_t N>
+    auto spiral(std::array<uint32_t, N> center, uint32_t from_radius, uint32_t to_radius, float turns, size_t points, size_t u = 0, size_t v = 1) {
+      return std::views::iota(size_t{ 0 }, points) | std::views::transform([=](size_t i) {
+               const float progress = static_cast<float>(i) / (points - 1);
+               const float angle = 2.0f * std::numbers::pi_v<float> * turns * progress;
+               const float radius = from_radius + (static_cast<float>(to_radius) - from_radius) * progress;
+               auto point = center;
+               point[u] = static_cast<uint32_t>(center[u] + radius * std::cos(angle));
+               point[v] = static_cast<uint32_t>(center[v] + radius * std::sin(angle));
+               return point;
+             });
+    }
+  }  // namespace Path
+}  // namespace Robot
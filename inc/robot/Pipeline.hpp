@@ -0,0 +1,366 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <utility>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "robot/Path.hpp"
+#include "task/Config.h"
+#include "telemetry/Telemetry.hpp"
+#include "telemetry/Trace.hpp"
+#include "utils/Ring.hpp"
+
+namespace Robot {
+  /**
+   * @brief Runs a robot as a pipeline of three stages split over both cores.
+   *
+   * - ingest: whoever calls submit(), on the I/O core, queues targets.
+   * - plan: a task on the motion core turns each target into segments,
+   *   up to DEPTH points ahead of the motors. Trajectories submitted
+   *   whole are planned through the robot's cache, so replays skip
+   *   planning.
+   * - dispatch: a higher priority task on the motion core switches the
+   *   DIR pins and fans every planned point out to the axes.
+   *
+   * Stages hand points over through lock-free rings and sleep on a task
+   * notification while there's nothing to do. Dispatch preempts planning
+   * the moment a point is done, so the motors only wait for the planner
+   * if it falls a whole ring behind. report() gives the share of time
+   * each stage spends working and how often that happened.
+   *
+   * @tparam RobotType A Coordinator.
+   * @tparam DEPTH Points each ring holds, a power of two.
+   *
+   * @note Points are planned from where the previous one ends, so
+   * nothing else may drive the robot until drain() returns.
+   */
+  template <typename RobotType, size_t DEPTH = 32>
+  class Pipeline final {
+   public:
+    using Position = typename RobotType::Position;
+
+    static constexpr size_t PLAN_PRIORITY = 5;
+    static constexpr size_t DISPATCH_PRIORITY = PLAN_PRIORITY + 1;
+
+    /// One stage over the window since the previous report()
+    struct Stage {
+      /// Points handled
+      uint32_t items;
+      /// Share of the window spent working, in percent
+      uint32_t utilization;
+    };
+
+    struct Report {
+      Stage ingest;
+      Stage plan;
+      /// Busy while the motors run, so this is the motors' duty cycle
+      Stage dispatch;
+      /// Points the motors waited for the planner on
+      uint32_t underruns;
+      /// Points submit() waited for room on
+      uint32_t backpressure;
+      /// Points run per second
+      uint32_t throughput;
+      uint32_t window_us;
+    };
+
+   private:
+    /// A single target, or a whole trajectory and the return to the
+    /// center when trajectory isn't empty
+    struct Command {
+      Position target;
+      std::span<const Position> trajectory;
+    };
+
+    struct Planned {
+      typename RobotType::PlannedPoint point;
+      Position target;
+    };
+
+    struct Counters {
+      std::atomic<uint32_t> items = 0;
+      std::atomic<uint32_t> busy_us = 0;
+      // Only touched by report()
+      uint32_t reported_items = 0;
+      uint32_t reported_busy_us = 0;
+
+      auto add(uint32_t busy, uint32_t count = 1) -> void {
+        items.fetch_add(count, std::memory_order_relaxed);
+        busy_us.fetch_add(busy, std::memory_order_relaxed);
+      }
+    };
+
+    RobotType& robot;
+
+    Utils::Ring<Command, DEPTH> commands;
+    Utils::Ring<Planned, DEPTH> planned;
+
+    std::atomic<TaskHandle_t> ingest_task = nullptr;
+    std::atomic<TaskHandle_t> plan_task = nullptr;
+    std::atomic<TaskHandle_t> dispatch_task = nullptr;
+
+    // Set once setup() returns on the dispatch task
+    std::atomic<bool> ready = false;
+    std::atomic<uint32_t> submitted = 0;
+    std::atomic<uint32_t> dispatched = 0;
+
+    Counters ingesting;
+    Counters planning;
+    Counters dispatching;
+    std::atomic<uint32_t> underruns = 0;
+    std::atomic<uint32_t> backpressure = 0;
+
+    struct {
+      uint32_t underruns = 0;
+      uint32_t backpressure = 0;
+      uint32_t at_us = 0;
+    } reported;
+
+    Telemetry::Channel telemetry;
+
+    static auto sleep() -> void {
+      const Telemetry::Trace::Scope trace{ "sleep" };
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    static auto wake(const std::atomic<TaskHandle_t>& task) -> void {
+      if (const auto handle = task.load())
+        xTaskNotifyGive(handle);
+    }
+
+    /// Push, sleeping while the ring is full. Notifications latch, so a
+    /// consumer that pops between the failed push and sleep() still
+    /// wakes the producer.
+    ///
+    /// @return µs spent asleep.
+    template <typename T>
+    static auto put(Utils::Ring<T, DEPTH>& ring, const T& item, const std::atomic<TaskHandle_t>& consumer) -> uint32_t {
+      uint32_t slept = 0;
+      while (not ring.push(item)) {
+        const auto since = Telemetry::now();
+        sleep();
+        slept += Telemetry::now() - since;
+      }
+
+      wake(consumer);
+      return slept;
+    }
+
+    auto plan_loop() -> void {
+      plan_task.store(xTaskGetCurrentTaskHandle());
+      while (not ready.load())
+        sleep();
+
+      auto state = robot.plan_state();
+      while (true) {
+        auto command = commands.pop();
+        if (not command) {
+          sleep();
+          continue;
+        }
+        wake(ingest_task);
+
+        if (command->trajectory.empty())
+          plan_one(state, command->target);
+        else
+          plan_whole(state, command->trajectory);
+      }
+    }
+
+    auto plan_one(typename RobotType::PlanState& state, const Position& target) -> void {
+      const auto start = Telemetry::now();
+      const Planned next = { .point = robot.plan_point(state, target), .target = target };
+      planning.add(Telemetry::now() - start);
+
+      put(planned, next, dispatch_task);
+    }
+
+    auto plan_whole(typename RobotType::PlanState& state, std::span<const Position> trajectory) -> void {
+      const auto start = Telemetry::now();
+      const auto points = robot.plan_cached(state, trajectory);
+      if (points.empty()) {
+        // Too long for the cache, plan it as it goes
+        for (const auto& target : trajectory)
+          plan_one(state, target);
+        plan_one(state, RobotType::CENTER);
+        return;
+      }
+      planning.add(Telemetry::now() - start, points.size());
+
+      for (size_t index = 0; index < points.size(); ++index)
+        put(planned, { .point = points[index], .target = index < trajectory.size() ? trajectory[index] : RobotType::CENTER }, dispatch_task);
+    }
+
+    auto dispatch_loop() -> void {
+      while (true) {
+        auto next = planned.pop();
+        if (not next) {
+          // Only an underrun if the point is on its way
+          if (dispatched.load() != submitted.load())
+            underruns.fetch_add(1, std::memory_order_relaxed);
+
+          do
+            sleep();
+          while (not(next = planned.pop()));
+        }
+        wake(plan_task);
+
+        const auto index = dispatched.load();
+        telemetry.push(Telemetry::Kind::SEGMENT, 0, index, planned.size());
+
+        const auto start = Telemetry::now();
+        robot.run_point(next->point, next->target);
+        dispatching.add(Telemetry::now() - start);
+
+        dispatched.store(index + 1);
+        wake(ingest_task);
+      }
+    }
+
+    auto queue(const Command& command, uint32_t points) -> void {
+      ingest_task.store(xTaskGetCurrentTaskHandle());
+
+      // Counted before they can run, so dispatch never finds them done
+      // yet uncounted and takes an empty ring for an underrun
+      submitted.fetch_add(points);
+
+      const auto start = Telemetry::now();
+      const auto slept = put(commands, command, plan_task);
+      if (slept > 0)
+        backpressure.fetch_add(1, std::memory_order_relaxed);
+
+      ingesting.add(Telemetry::now() - start - slept, points);
+    }
+
+    auto stage(Counters& counters, uint32_t window_us) -> Stage {
+      const auto items = counters.items.load(std::memory_order_relaxed);
+      const auto busy = counters.busy_us.load(std::memory_order_relaxed);
+      const Stage result = {
+        .items = items - counters.reported_items,
+        .utilization = window_us == 0 ? 0 : static_cast<uint32_t>(uint64_t{ busy - counters.reported_busy_us } * 100 / window_us),
+      };
+
+      counters.reported_items = items;
+      counters.reported_busy_us = busy;
+      return result;
+    }
+
+   public:
+    /**
+     * @param robot Robot to drive, it must outlive the pipeline.
+     * @param channel Telemetry name for segment progress.
+     */
+    explicit Pipeline(RobotType& robot, const char* channel = "pipeline") : robot(robot), telemetry(channel) {}
+
+    Pipeline(const Pipeline&) = delete;
+    auto operator=(const Pipeline&) -> Pipeline& = delete;
+
+    /**
+     * @brief Start the plan and dispatch tasks on the motion core.
+     *
+     * Call it once, before anything else drives the robot, so the axis
+     * workers start on the motion core at the dispatch priority too.
+     *
+     * @param setup Called with the robot on the dispatch task before
+     * the first point, calibration goes here. Planning starts from
+     * wherever it leaves the axes.
+     */
+    template <typename FnType>
+    auto start(FnType&& setup) -> void {
+      reported.at_us = Telemetry::now();
+
+      Task::Config().pinned_to_core(Task::Config::MOTION_CORE).with_name("plan").with_priority(PLAN_PRIORITY).with_stack_size(4096).done();
+      std::thread([this]() { plan_loop(); }).detach();
+
+      Task::Config().pinned_to_core(Task::Config::MOTION_CORE).with_name("dispatch").with_priority(DISPATCH_PRIORITY).with_stack_size(4096).done();
+      std::thread([this, setup = std::forward<FnType>(setup)]() mutable {
+        dispatch_task.store(xTaskGetCurrentTaskHandle());
+        setup(robot);
+
+        ready.store(true);
+        wake(plan_task);
+        wake(ingest_task);
+        dispatch_loop();
+      }).detach();
+
+      Task::Config().done();
+    }
+
+    /**
+     * @brief Queue a target, sleeping while the queue is full.
+     *
+     * Call it from a single task, on the I/O core.
+     */
+    auto submit(const Position& target) -> void { queue({ .target = target, .trajectory = {} }, 1); }
+
+    /**
+     * @brief Queue a trajectory stored in memory, followed by the return
+     * to the center.
+     *
+     * It's planned in one go through the robot's trajectory cache, so a
+     * replay costs no planning at all. The points must stay put until
+     * drain() returns.
+     */
+    auto submit(const std::span<const Position> trajectory) -> void { queue({ .target = {}, .trajectory = trajectory }, trajectory.size() + 1); }
+
+    /**
+     * @brief Queue a whole trajectory, followed by the return to the center.
+     *
+     * Any range of Positions goes, lazy ones (see Path) are generated
+     * point by point as the queue drains, without the cache.
+     */
+    template <IsPath<Position> PathType>
+      requires(not std::convertible_to<PathType, std::span<const Position>>)
+    auto submit(PathType&& trajectory) -> void {
+      for (const auto& target : trajectory)
+        submit(target);
+      submit(RobotType::CENTER);
+    }
+
+    /**
+     * @brief Sleep until setup and every submitted point are done.
+     *
+     * Call it from the task that submits.
+     */
+    auto drain() -> void {
+      ingest_task.store(xTaskGetCurrentTaskHandle());
+      while (not ready.load() or dispatched.load() != submitted.load())
+        sleep();
+    }
+
+    /**
+     * @brief What every stage did since the previous report.
+     *
+     * Call it from a single task.
+     */
+    auto report() -> Report {
+      const auto now = Telemetry::now();
+      const auto window = now - reported.at_us;
+      reported.at_us = now;
+
+      const auto underran = underruns.load(std::memory_order_relaxed);
+      const auto pushed_back = backpressure.load(std::memory_order_relaxed);
+
+      Report report = {
+        .ingest = stage(ingesting, window),
+        .plan = stage(planning, window),
+        .dispatch = stage(dispatching, window),
+        .underruns = underran - reported.underruns,
+        .backpressure = pushed_back - reported.backpressure,
+        .throughput = 0,
+        .window_us = window,
+      };
+      report.throughput = window == 0 ? 0 : static_cast<uint32_t>(uint64_t{ report.dispatch.items } * 1'000'000 / window);
+
+      reported.underruns = underran;
+      reported.backpressure = pushed_back;
+      return report;
+    }
+  };
+}  // namespace Robot
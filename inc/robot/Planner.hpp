@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+#include "robot/Microstep.hpp"
+
+namespace Robot {
+  /**
+   * @brief Part of an axis move made at a single microstep resolution.
+   */
+  struct Segment {
+    /// Finest-resolution steps, positive towards COUNTER_CLOCKWISE
+    int32_t steps;
+    Microstep mode;
+  };
+
+  /// A planned axis move: at most a lead-in, the rapid and the finishing tail
+  using Plan = std::array<Segment, 3>;
+
+  /**
+   * @brief How long a move takes on the motor, and how fast it gets.
+   */
+  struct SegmentTiming {
+    /// From the start of the first pulse to the end of the last one
+    uint32_t duration_us;
+    /// Fastest the move steps, in finest steps per second
+    uint32_t peak_rate;
+    /// Some pause was longer than the motor can encode and was cut short
+    bool clamped;
+    /// How far the step rate comes out from the one asked for, since
+    /// the motor times pulses in whole clock ticks, in parts per million
+    uint32_t error_ppm;
+  };
+
+  /**
+   * @brief Splits axis moves into segments, trading resolution for speed.
+   *
+   * Long moves run their bulk in the coarsest mode, which covers the
+   * most distance per pulse, and finish in the finest mode so the final
+   * position keeps full resolution. Since the driver only stays exact
+   * when a coarse step starts on its grid, a short fine lead-in first
+   * brings the indexer onto it.
+   *
+   * @tparam Modes Microstep mode pins of the motor.
+   */
+  template <IsModeSelector Modes>
+  struct Planner {
+    /// Moves shorter than this many full steps stay in the finest mode,
+    /// switching wouldn't win back the lead-in and tail.
+    static constexpr int32_t RAPID_THRESHOLD = 4;
+
+    /**
+     * @brief How far the indexer is past the coarse grid. Plans only
+     * depend on the phase through this.
+     */
+    static constexpr auto offset(int32_t phase) -> int32_t {
+      constexpr auto STRIDE = static_cast<int32_t>(stride<Modes>(Modes::COARSEST));
+      return ((phase % STRIDE) + STRIDE) % STRIDE;
+    }
+
+    /**
+     * @brief Plan a move.
+     *
+     * @param phase Where the driver's indexer will be when the move
+     * starts, in finest steps (see Motor::phase()).
+     * @param delta Finest steps to travel.
+     *
+     * @return The segments to run in order, unused ones have zero steps.
+     */
+    static constexpr auto plan(int32_t phase, int32_t delta) -> Plan {
+      constexpr auto FINE = Modes::FINEST;
+      constexpr auto RAPID = Modes::COARSEST;
+      constexpr auto STRIDE = static_cast<int32_t>(stride<Modes>(RAPID));
+
+      const auto distance = std::abs(delta);
+      if (FINE == RAPID or distance < RAPID_THRESHOLD * static_cast<int32_t>(stride<Modes>(Microstep::FULL)))
+        return { Segment{ delta, FINE }, Segment{ 0, FINE }, Segment{ 0, FINE } };
+
+      const auto sign = delta > 0 ? 1 : -1;
+      const auto misalignment = offset(phase);
+
+      const auto lead = sign > 0 ? (STRIDE - misalignment) % STRIDE : misalignment;
+      const auto rapid = (distance - lead) / STRIDE * STRIDE;
+      const auto tail = distance - lead - rapid;
+
+      return {
+        Segment{ sign * lead, FINE },
+        Segment{ sign * rapid, RAPID },
+        Segment{ sign * tail, FINE },
+      };
+    }
+  };
+}  // namespace Robot
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "peripherals/GPIO.hpp"
+#include "peripherals/PCNT.hpp"
+#include "peripherals/PWM.hpp"
+#include "robot/Feed.hpp"
+#include "robot/Microstep.hpp"
+#include "robot/Planner.hpp"
+#include "robot/Shaper.hpp"
+#include "telemetry/Trace.hpp"
+#include "utils/Frequency.hpp"
+#include "utils/Realtime.hpp"
+
+namespace Robot {
+  namespace {
+    using namespace Utils::literals;
+  }
+
+  /**
+   * @brief Stepper Motor Driver using LEDC for the pulses and PCNT to
+   * count them, a drop-in for Motor that leaves the RMT channels free.
+   *
+   * The LEDC channel runs a plain square wave at the step rate and the
+   * pulse counter watches the same pin. Once the last pulse of a move is
+   * out, the counter's interrupt cuts the wave, half a period before the
+   * next pulse would have started. Pulses are counted as they leave the
+   * pin, so positions are exact rather than interpolated, and nothing
+   * needs refilling mid-move.
+   *
+   * Every move runs at a constant rate, so input shapers are ignored.
+   *
+   * @tparam step_pin GPIO pin for Step signal.
+   * @tparam dir_pin GPIO pin for Direction signal.
+   * @tparam timer LEDC timer, one per motor since each sets its own rate.
+   * @tparam channel LEDC channel.
+   * @tparam ModePins Microstep mode pins, Hardwired if the board fixes them.
+   *
+   * @note The PCNT interrupt reads the counters in here, so motors must
+   * live in internal RAM (static or global objects do) for it to keep
+   * running while the flash is busy.
+   */
+  template <uint8_t step_pin, uint8_t dir_pin, Peripherals::PWMTimer timer, Peripherals::PWMChannel channel, IsModeSelector ModePins = Hardwired>
+  class PwmMotor {
+   public:
+    using Modes = ModePins;
+
+    enum class Direction {
+      CLOCKWISE = static_cast<bool>(Peripherals::GPIO::Level::HIGH),
+      COUNTER_CLOCKWISE = static_cast<bool>(Peripherals::GPIO::Level::LOW),
+    };
+
+    /// GPIO of the DIR signal, for driving several motors through a Port
+    static constexpr uint8_t DIR_PIN = dir_pin;
+
+    /// See Motor::DIR_SETUP_US
+    static constexpr uint32_t DIR_SETUP_US = 1;
+
+   private:
+    using DirectionPin = Peripherals::GPIO::Output<dir_pin>;
+    using Wave = Peripherals::PWM<step_pin, timer, channel>;
+
+   public:
+    /// Slowest and fastest step rates move() takes, what the LEDC divider
+    /// reaches at its duty resolution
+    static constexpr uint32_t MIN_RATE = Wave::MIN_FREQ;
+    static constexpr uint32_t MAX_RATE = Wave::MAX_FREQ;
+
+   private:
+    // Step rate at a 100% feed and the fastest any override may drive
+    // the motor to, see Motor
+    static constexpr uint32_t SPEED = 500_Hz;
+    static constexpr uint32_t MAX_VELOCITY = SPEED * 3 / 2 * Robot::stride<Modes>(Microstep::FULL);
+    // Shortest STEP pulse the DRV8825 takes (datasheet, timing
+    // requirements). Shorter ones are left uncounted, since the driver
+    // wouldn't step on them either.
+    static constexpr uint32_t MIN_PULSE_NS = 1900;
+
+    using Counter = Peripherals::PCNT<step_pin, 0x7FFF, MIN_PULSE_NS>;
+
+    // The counter enables the pin's input on top of the PWM output, so
+    // it has to come second
+    Wave pwm;
+    Counter counter;
+
+    StaticSemaphore_t idle_buffer;
+    SemaphoreHandle_t idle = xSemaphoreCreateBinaryStatic(&idle_buffer);
+    std::atomic<bool> moving = false;
+
+    // Same seqlock as Motor, the ISR writes while moving and the owning
+    // task while idle. stop() silences the ISR the same way Motor's does.
+    std::atomic<uint32_t> seq = 0;
+    std::atomic<bool> stopping = false;
+    std::atomic<bool> in_isr = false;
+    std::atomic<int32_t> steps_done = 0;
+    std::atomic<int32_t> steps_target = 0;
+    std::atomic<int32_t> step_stride = 1;
+    std::atomic<uint32_t> pulses_target = 0;
+    // Times the counter wrapped around during the move in progress
+    std::atomic<uint32_t> laps = 0;
+    // When the last pulse of the move in progress should end
+    std::atomic<uint32_t> move_end_us = 0;
+    // Worst delay between the last pulse of a move and its interrupt
+    std::atomic<uint32_t> worst_latency_us = 0;
+
+    int32_t origin = 0;
+    Microstep mode = Modes::COARSEST;
+    Direction direction = Direction::CLOCKWISE;
+
+    /// LEDC frequency for a move starting now: rate_hz within
+    /// MIN_RATE..MAX_RATE, or for 0 SPEED as scaled by the Feed override
+    /// and held to MAX_VELOCITY at a stride of finest steps per pulse
+    static auto pulse_rate(uint32_t rate_hz, uint32_t stride) -> uint32_t {
+      if (rate_hz == 0)
+        return std::min(SPEED * Feed::current() / 100, MAX_VELOCITY / stride);
+      return std::clamp(rate_hz, MIN_RATE, MAX_RATE);
+    }
+
+    /// How far the LEDC comes out from a rate, in parts per million
+    static constexpr auto error_ppm(uint32_t rate) -> uint32_t {
+      const auto exact = int64_t{ Wave::CLOCK_HZ } << 8;
+      const auto off = static_cast<int64_t>(Wave::divider(rate) * (uint64_t{ rate } << Wave::RESOLUTION)) - exact;
+      return static_cast<uint32_t>((off < 0 ? -off : off) * 1'000'000 / exact);
+    }
+
+    /// The wave starts on a rising edge, so the last falling one comes
+    /// half a period before the end of the last pulse
+    static auto duration_us(uint32_t pulses, uint32_t rate) -> uint32_t {
+      return static_cast<uint32_t>((uint64_t{ pulses } * 2'000'000 - 1'000'000 + rate) / (2 * rate));
+    }
+
+    REALTIME_ATTR static auto now_us() -> uint32_t { return static_cast<uint32_t>(esp_timer_get_time()); }
+
+    template <typename FnType>
+    auto publish(FnType&& update) -> void {
+      seq.fetch_add(1);
+      update();
+      seq.fetch_add(1);
+    }
+
+    // Everything here has to be in IRAM (see utils/Realtime.hpp)
+    REALTIME_ATTR static auto on_reach(pcnt_unit_handle_t, const pcnt_watch_event_data_t* edata, void* arg) -> bool {
+      PwmMotor* self = static_cast<PwmMotor*>(arg);
+      const auto now = now_us();
+      const Telemetry::Trace::Scope trace{ "pcnt isr", step_pin };
+
+      self->in_isr.store(true);
+      if (self->stopping.load() or not self->moving.load(std::memory_order_relaxed)) {
+        self->in_isr.store(false);
+        return false;
+      }
+
+      // The limit wraps the counter back to 0, the other watch point is
+      // where the last lap ends. It's passed on every lap before that too.
+      const auto wrapped = edata->watch_point_value == Counter::LIMIT;
+      const auto lap = self->laps.load(std::memory_order_relaxed) + (wrapped ? 1 : 0);
+      const auto counted = lap * Counter::LIMIT + (wrapped ? 0 : edata->watch_point_value);
+
+      if (counted < self->pulses_target.load(std::memory_order_relaxed)) {
+        if (wrapped) {
+          self->seq.fetch_add(1);
+          self->laps.store(lap);
+          self->seq.fetch_add(1);
+        }
+        self->in_isr.store(false);
+        return false;
+      }
+
+      // Counted on the falling edge, the next pulse is half a period away
+      self->pwm.halt();
+
+      const auto late = static_cast<int32_t>(now - self->move_end_us.load(std::memory_order_relaxed));
+      if (late > 0 and static_cast<uint32_t>(late) > self->worst_latency_us.load(std::memory_order_relaxed))
+        self->worst_latency_us.store(late, std::memory_order_relaxed);
+
+      // Same as publish()
+      self->seq.fetch_add(1);
+      self->laps.store(lap);
+      self->steps_done.store(self->steps_target.load());
+      self->seq.fetch_add(1);
+
+      self->moving.store(false);
+      self->in_isr.store(false);
+      Telemetry::Trace::instant("segment done", step_pin);
+      BaseType_t woken = pdFALSE;
+      xSemaphoreGiveFromISR(self->idle, &woken);
+      return woken == pdTRUE;
+    }
+
+   public:
+    /// Finest resolution this driver can step at
+    static constexpr auto FINEST = Modes::FINEST;
+    /// Coarsest, and therefore fastest, resolution
+    static constexpr auto COARSEST = Modes::COARSEST;
+
+    PwmMotor() {
+      DirectionPin::initialize();
+      DirectionPin::set(static_cast<Peripherals::GPIO::Level>(direction));
+      Modes::initialize();
+      counter.on_reach(on_reach, this);
+    }
+
+    /**
+     * @brief Move the motor, see Motor::move().
+     *
+     * The LEDC runs at a whole number of Hz, for the default rate rounded
+     * down from what the Feed override asks for.
+     *
+     * @param shaper Ignored, moves always run at a constant rate.
+     * @param rate_hz Pulses per second, from MIN_RATE to MAX_RATE, or 0
+     * for the default rate.
+     */
+    auto move(Direction dir, size_t steps, bool sync = false, Microstep resolution = Modes::FINEST, [[maybe_unused]] const Shaper& shaper = {}, uint32_t rate_hz = 0) -> void {
+      const auto stride = Robot::stride<Modes>(resolution);
+      const auto pulses = steps / stride;
+      if (pulses == 0)
+        return;
+
+      Telemetry::Trace::instant("segment enqueue", step_pin);
+      wait();
+      // Drop the wake-up of a move nobody waited for
+      xSemaphoreTake(idle, 0);
+
+      if (dir != direction) {
+        DirectionPin::set(static_cast<Peripherals::GPIO::Level>(dir));
+        direction = dir;
+        esp_rom_delay_us(DIR_SETUP_US);
+      }
+
+      if (resolution != mode) {
+        Modes::set(resolution);
+        mode = resolution;
+      }
+
+      const auto rate = pulse_rate(rate_hz, stride);
+      counter.watch(static_cast<int>(pulses % Counter::LIMIT));
+      counter.clear();
+
+      publish([&]() {
+        const auto travel = static_cast<int32_t>(pulses * stride);
+        steps_target.store(steps_done.load() + (dir == Direction::COUNTER_CLOCKWISE ? travel : -travel));
+        step_stride.store(stride);
+        pulses_target.store(pulses);
+        laps.store(0);
+        move_end_us.store(now_us() + duration_us(pulses, rate));
+      });
+
+      moving.store(true);
+      Telemetry::Trace::instant("segment start", step_pin);
+      pwm.set(rate, 0.5);
+      pwm.restart();
+
+      if (sync)
+        wait();
+    }
+
+    /**
+     * @brief How long move() takes to send a move, without sending it.
+     *
+     * From the first rising edge to the falling edge of the last pulse,
+     * where the interrupt cuts the wave, at the Feed override in effect
+     * for the default rate. The LEDC divider has 8 fractional bits, so
+     * this is off by error_ppm, around 100 at most.
+     */
+    static auto timing(size_t steps, Microstep resolution, [[maybe_unused]] const Shaper& shaper = {}, uint32_t rate_hz = 0) -> SegmentTiming {
+      const auto stride = Robot::stride<Modes>(resolution);
+      const auto pulses = static_cast<uint32_t>(steps / stride);
+      if (pulses == 0)
+        return { .duration_us = 0, .peak_rate = 0, .clamped = false, .error_ppm = 0 };
+
+      const auto rate = pulse_rate(rate_hz, stride);
+      return { .duration_us = duration_us(pulses, rate), .peak_rate = stride * rate, .clamped = false, .error_ppm = error_ppm(rate) };
+    }
+
+    /**
+     * @brief Direction the DIR pin is currently driven to.
+     */
+    auto heading() const -> Direction { return direction; }
+
+    /**
+     * @brief See Motor::assume_heading().
+     */
+    auto assume_heading(Direction dir) -> void { direction = dir; }
+
+    /**
+     * @brief Blocks until the motor finishes the current move.
+     */
+    auto wait() -> void {
+      if (moving.load()) {
+        const Telemetry::Trace::Scope trace{ "wait", step_pin };
+        xSemaphoreTake(idle, portMAX_DELAY);
+      }
+    }
+
+    /**
+     * @brief Instantaneous position, in finest steps since the last home().
+     *
+     * Counted by the PCNT, so it's exact. For the few µs between the
+     * counter wrapping around (every 32767 pulses) and its interrupt,
+     * it can read one lap short.
+     *
+     * Lock-free and safe to call from any core while the motor moves.
+     */
+    auto position() const -> int32_t {
+      uint32_t version;
+      int32_t done, target, stride;
+      uint32_t wraps;
+
+      do {
+        version = seq.load();
+        done = steps_done.load();
+        target = steps_target.load();
+        stride = step_stride.load();
+        wraps = laps.load();
+      } while ((version & 1) or version != seq.load());
+
+      if (done == target)
+        return done;
+
+      const int64_t pulsed = int64_t{ wraps } * Counter::LIMIT + counter.count();
+      const auto in_flight = std::min<int64_t>(pulsed * stride, std::abs(target - done));
+
+      return done + static_cast<int32_t>(target > done ? in_flight : -in_flight);
+    }
+
+    /**
+     * @brief Worst delay between the last pulse of a move and the
+     * interrupt that ends it since the last reset_latency(), in µs.
+     */
+    auto latency() const -> uint32_t { return worst_latency_us.load(std::memory_order_relaxed); }
+
+    auto reset_latency() -> void { worst_latency_us.store(0, std::memory_order_relaxed); }
+
+    /**
+     * @brief See Motor::phase().
+     */
+    auto phase() const -> int32_t { return origin + steps_target.load(); }
+
+    /**
+     * @brief Declare the current position as step zero.
+     */
+    auto home() -> void {
+      origin += steps_target.load();
+      publish([&]() {
+        steps_done.store(0);
+        steps_target.store(0);
+      });
+    }
+
+    /**
+     * @brief Emergency stop.
+     *
+     * The position is frozen at wherever the pulses were cut off, so
+     * position() stays correct afterwards.
+     */
+    auto stop() -> void {
+      stopping.store(true);
+      while (in_isr.load())
+        ;
+
+      pwm.halt();
+      const auto here = position();
+      moving.store(false);
+
+      publish([&]() {
+        steps_done.store(here);
+        steps_target.store(here);
+      });
+      stopping.store(false);
+
+      // Wake up whoever waits for the move
+      xSemaphoreGive(idle);
+    }
+  };
+}  // namespace Robot
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+
+namespace Robot {
+  /**
+   * @brief Input shaper, cancels a resonance of the frame by splitting
+   * every move into a few delayed, scaled copies of itself.
+   *
+   * The impulses are timed so the vibration excited by one copy is
+   * cancelled by the next ones. Since every move here runs at a constant
+   * step rate, the shaped move is just a handful of constant-rate phases,
+   * which the motor encodes like any other move. The cost is that moves
+   * take longer, by half a resonance period (ZV) or a whole one (ZVD, EI).
+   *
+   * - ZV: shortest, but only cancels the exact frequency.
+   * - ZVD: robust to about ±20% of error in the frequency.
+   * - EI: tolerates 5% of residual vibration at the frequency and is
+   *   robust over a wider band than ZVD.
+   *
+   * tools/shaper.py simulates the residual vibration of each one.
+   */
+  class Shaper {
+   public:
+    enum class Type : uint8_t {
+      NONE,
+      ZV,
+      ZVD,
+      EI,
+    };
+
+    static constexpr size_t MAX_IMPULSES = 3;
+    /// A phase starts or ends at every impulse and every impulse plus the move
+    static constexpr size_t MAX_PHASES = 2 * MAX_IMPULSES - 1;
+
+    struct Impulse {
+      float amplitude;
+      uint32_t time_us;
+    };
+
+    /// Part of a shaped move stepping at a constant rate. Times are in
+    /// the unit shape() got the interval in.
+    struct Phase {
+      uint32_t pulses;
+      uint32_t period;
+      /// From the previous pulse to the first one of the phase. The
+      /// first phase counts from half a period before the move starts,
+      /// so that unshaped moves are a plain run of periods.
+      uint32_t lead;
+    };
+
+    struct Profile {
+      std::array<Phase, MAX_PHASES> phases;
+      size_t count;
+
+      auto begin() const { return phases.begin(); }
+      auto end() const { return phases.begin() + count; }
+    };
+
+   private:
+    // Residual vibration EI accepts at the design frequency
+    static constexpr float EI_TOLERANCE = 0.05f;
+
+    std::array<Impulse, MAX_IMPULSES> train = { Impulse{ 1.0f, 0 } };
+    size_t impulses = 1;
+
+   public:
+    /// No shaping, moves run as they are
+    Shaper() = default;
+
+    /**
+     * @param type Shaper to use.
+     * @param frequency_hz Resonance to cancel, as measured on the frame.
+     * @param damping Damping ratio of that resonance, 0.1 is typical
+     * of a light aluminium frame.
+     */
+    Shaper(Type type, float frequency_hz, float damping = 0.1f) {
+      if (type == Type::NONE or frequency_hz <= 0.0f)
+        return;
+
+      const float k = std::exp(-damping * std::numbers::pi_v<float> / std::sqrt(1.0f - damping * damping));
+      const auto half_period_us = static_cast<uint32_t>(500'000.0f / (frequency_hz * std::sqrt(1.0f - damping * damping)));
+
+      std::array<float, MAX_IMPULSES> amplitudes = {};
+      switch (type) {
+        case Type::NONE: return;
+        case Type::ZV:
+          amplitudes = { 1.0f, k };
+          impulses = 2;
+          break;
+        case Type::ZVD:
+          amplitudes = { 1.0f, 2.0f * k, k * k };
+          impulses = 3;
+          break;
+        case Type::EI:
+          amplitudes = { 0.25f * (1.0f + EI_TOLERANCE), 0.5f * (1.0f - EI_TOLERANCE) * k, 0.25f * (1.0f + EI_TOLERANCE) * k * k };
+          impulses = 3;
+          break;
+      }
+
+      float total = 0.0f;
+      for (size_t i = 0; i < impulses; ++i)
+        total += amplitudes[i];
+
+      for (size_t i = 0; i < impulses; ++i)
+        train[i] = { amplitudes[i] / total, static_cast<uint32_t>(i * half_period_us) };
+    }
+
+    /**
+     * @brief How long shaping makes every move, in µs.
+     */
+    auto delay_us() const -> uint32_t { return train[impulses - 1].time_us; }
+
+    /**
+     * @brief Shape a move of pulses at a constant period.
+     *
+     * Each pulse goes where the shaped move crosses the middle of its
+     * step, so the pulses follow the shaped move as closely as whole
+     * steps can. Intervals where nothing moves turn into longer leads,
+     * up to what the motor can encode.
+     *
+     * @param pulses Pulses in the move.
+     * @param interval Time between them, in any unit.
+     * @param ticks_per_us Units of interval per µs, for motors timing
+     * pulses finer than a µs.
+     */
+    auto shape(uint32_t pulses, uint32_t interval, uint32_t ticks_per_us = 1) const -> Profile {
+      if (impulses == 1 or pulses == 0)
+        return { .phases = { Phase{ pulses, interval, interval } }, .count = 1 };
+
+      const float length = static_cast<float>(pulses) * interval;
+      // Impulse times in the unit of interval
+      std::array<float, MAX_IMPULSES> times;
+      for (size_t i = 0; i < impulses; ++i)
+        times[i] = static_cast<float>(train[i].time_us) * ticks_per_us;
+
+      std::array<float, 2 * MAX_IMPULSES> edges;
+      for (size_t i = 0; i < impulses; ++i) {
+        edges[2 * i] = times[i];
+        edges[2 * i + 1] = times[i] + length;
+      }
+      std::sort(edges.begin(), edges.begin() + 2 * impulses);
+
+      // Pulses the shaped move has made by time t, fractions included
+      const auto made = [&](float t) {
+        float position = 0.0f;
+        for (size_t i = 0; i < impulses; ++i)
+          position += train[i].amplitude * std::clamp((t - times[i]) / length, 0.0f, 1.0f);
+        return position * pulses;
+      };
+
+      Profile profile = { .phases = {}, .count = 0 };
+      uint32_t done = 0;
+      // Rising edge of the last pulse, as the motor will send it
+      float last_edge = -0.5f * interval;
+
+      for (size_t edge = 0; edge + 1 < 2 * impulses; ++edge) {
+        const auto from = made(edges[edge]);
+        const auto to = made(edges[edge + 1]);
+        if (to <= from)
+          continue;
+
+        // Pulse j belongs here if j - 0.5 falls within [from, to)
+        const auto last = edge + 2 == 2 * impulses ? pulses : std::min(pulses, static_cast<uint32_t>(to + 0.5f));
+        if (last <= done)
+          continue;
+
+        const auto rate = (to - from) / (edges[edge + 1] - edges[edge]);
+        const auto first_edge = edges[edge] + (static_cast<float>(done) + 0.5f - from) / rate;
+
+        const auto period = static_cast<uint32_t>(std::lround(1.0f / rate));
+        const auto lead = static_cast<uint32_t>(std::lround(std::max(first_edge - last_edge, 1.0f)));
+        const auto count = last - done;
+
+        profile.phases[profile.count++] = { count, period, lead };
+        last_edge += lead + static_cast<float>(count - 1) * period;
+        done = last;
+      }
+
+      return profile;
+    }
+  };
+}  // namespace Robot
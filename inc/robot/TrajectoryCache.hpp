@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace Robot {
+  /**
+   * @brief Fixed-budget LRU cache of planned trajectories.
+   *
+   * Trajectories live back to back in an arena sized at compile time, so
+   * caching never allocates. When a new one doesn't fit, the least
+   * recently used ones are evicted and the survivors compacted until it
+   * does.
+   *
+   * @tparam Point One planned trajectory point.
+   * @tparam budget Bytes of points the cache may hold.
+   * @tparam max_entries Trajectories the cache may hold.
+   */
+  template <typename Point, size_t budget, size_t max_entries = 8>
+  class TrajectoryCache final {
+   public:
+    /// Points the arena holds
+    static constexpr size_t CAPACITY = budget / sizeof(Point);
+    static_assert(CAPACITY > 0, "The budget doesn't fit a single point!");
+
+    struct Stats {
+      uint32_t hits;
+      uint32_t misses;
+      uint32_t evictions;
+      size_t bytes_used;
+      size_t bytes_budget;
+    };
+
+   private:
+    struct Entry {
+      uint64_t key = 0;
+      size_t offset = 0;
+      size_t count = 0;
+      uint32_t last_used = 0;
+      bool valid = false;
+    };
+
+    std::array<Point, CAPACITY> arena;
+    std::array<Entry, max_entries> entries = {};
+    size_t used = 0;
+    uint32_t clock = 0;
+
+    // Counters are read from other tasks, the rest belongs to the owner
+    std::atomic<uint32_t> hits = 0;
+    std::atomic<uint32_t> misses = 0;
+    std::atomic<uint32_t> evictions = 0;
+    std::atomic<size_t> bytes_used = 0;
+
+    auto evict_oldest() -> void {
+      Entry* oldest = nullptr;
+      for (auto& entry : entries)
+        if (entry.valid and (oldest == nullptr or entry.last_used < oldest->last_used))
+          oldest = &entry;
+
+      oldest->valid = false;
+      evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Slide the remaining trajectories to the front of the arena, so
+    /// that free space is always at its end
+    auto compact() -> void {
+      std::array<Entry*, max_entries> order = {};
+      size_t live = 0;
+      for (auto& entry : entries)
+        if (entry.valid)
+          order[live++] = &entry;
+
+      std::sort(order.begin(), order.begin() + live, [](const Entry* a, const Entry* b) { return a->offset < b->offset; });
+
+      used = 0;
+      for (size_t i = 0; i < live; ++i) {
+        auto& entry = *order[i];
+        std::copy(arena.begin() + entry.offset, arena.begin() + entry.offset + entry.count, arena.begin() + used);
+        entry.offset = used;
+        used += entry.count;
+      }
+    }
+
+   public:
+    /**
+     * @brief Look a trajectory up, counting a hit or a miss.
+     *
+     * @return Its points, empty if it isn't cached.
+     */
+    auto find(uint64_t key) -> std::span<const Point> {
+      for (auto& entry : entries) {
+        if (entry.valid and entry.key == key) {
+          entry.last_used = ++clock;
+          hits.fetch_add(1, std::memory_order_relaxed);
+          return { arena.data() + entry.offset, entry.count };
+        }
+      }
+
+      misses.fetch_add(1, std::memory_order_relaxed);
+      return {};
+    }
+
+    /**
+     * @brief Make room for a trajectory, evicting old ones if needed.
+     *
+     * The caller fills the points in before the next call to the cache.
+     *
+     * @return Where to write its points, empty if it could never fit.
+     */
+    auto insert(uint64_t key, size_t count) -> std::span<Point> {
+      if (count == 0 or count > CAPACITY)
+        return {};
+
+      const auto free_slot = [&] { return std::find_if(entries.begin(), entries.end(), [](const Entry& entry) { return not entry.valid; }); };
+
+      while (free_slot() == entries.end() or used + count > CAPACITY) {
+        evict_oldest();
+        compact();
+      }
+
+      auto& entry = *free_slot();
+      entry = { .key = key, .offset = used, .count = count, .last_used = ++clock, .valid = true };
+      used += count;
+      bytes_used.store(used * sizeof(Point), std::memory_order_relaxed);
+
+      return { arena.data() + entry.offset, count };
+    }
+
+    auto stats() const -> Stats {
+      return {
+        .hits = hits.load(std::memory_order_relaxed),
+        .misses = misses.load(std::memory_order_relaxed),
+        .evictions = evictions.load(std::memory_order_relaxed),
+        .bytes_used = bytes_used.load(std::memory_order_relaxed),
+        .bytes_budget = CAPACITY * sizeof(Point),
+      };
+    }
+  };
+}  // namespace Robot
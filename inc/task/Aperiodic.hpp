@@ -6,6 +6,8 @@
 #include "freertos/idf_additions.h"
 #include "task/Config.h"
 #include "task/Query.h"
+#include "telemetry/Trace.hpp"
+#include "utils/Realtime.hpp"
 #include "utils/print.hpp"
 
 namespace Task {
@@ -38,15 +40,19 @@ namespace Task {
         Config(true).with_priority(Config::MAX_PRIORITY);
 
       auto wrapper = [=]() {
+        const auto name = Query::this_thread::name();
         while (true)
-          if (xSemaphoreTake(sem, portMAX_DELAY) == pdTRUE)
+          if (xSemaphoreTake(sem, portMAX_DELAY) == pdTRUE) {
+            const Telemetry::Trace::Scope trace{ name };
             fn(args...);
+          }
       };
       return wrapper;
     }
 
-    static void IRAM_ATTR isr_handler(void* arg) {
+    static void REALTIME_ATTR isr_handler(void* arg) {
       Aperiodic* self = static_cast<Aperiodic*>(arg);
+      const Telemetry::Trace::Scope trace{ "event isr" };
 
       if (BaseType_t xHigherPriorityTaskWoken = pdFALSE; self->trigger_sem)
         xSemaphoreGiveFromISR(self->trigger_sem, &xHigherPriorityTaskWoken);
@@ -2,6 +2,7 @@
 
 #include "FreeRTOSConfig.h"
 #include "esp_pthread.h"
+#include "freertos/FreeRTOS.h"
 
 namespace Task {
   /// Syntatic sugar for creating and applying the pthread
@@ -16,6 +17,9 @@ namespace Task {
   class Config {
    private:
     esp_pthread_cfg_t config;
+    // Whether a task is being set up, rather than the defaults restored
+    // with Task::Config().done()
+    bool configured = false;
 
    public:
     /// Minimum priority that can be assigned to a task
@@ -26,6 +30,12 @@ namespace Task {
     /// determine its priority based on the period assigned to it
     static constexpr size_t AUTOMATIC_PRIORITY = configMAX_PRIORITIES + 1;
 
+    /// Core for command ingestion, telemetry and logging
+    static constexpr int IO_CORE = 0;
+    /// Core for planning and step dispatch, the same one on single
+    /// core chips
+    static constexpr int MOTION_CORE = portNUM_PROCESSORS - 1;
+
     /// Create the default configuration for the thread.
     ///
     /// @param keep_current This is used to determine whether the
@@ -46,21 +56,22 @@ namespace Task {
     auto done() -> void;
 
     /// Specify the stack size for this thread
-    auto with_stack_size(size_t size) -> Config;
+    auto with_stack_size(size_t size) -> Config&;
 
     /// Specify the priority of this thread
-    auto with_priority(size_t priority) -> Config;
+    auto with_priority(size_t priority) -> Config&;
 
     /// Specify the name of the thread
-    auto with_name(const char* name) -> Config;
+    auto with_name(const char* name) -> Config&;
 
     /// Specify the core in which the thread will run
-    auto pinned_to_core(int core) -> Config;
+    auto pinned_to_core(int core) -> Config&;
 
     /// Children threads will inherit this same configuration
-    auto inherit_further() -> Config;
+    auto inherit_further() -> Config&;
 
-    /// Apply the config using esp_pthread_set_cfg
+    /// Apply the config using esp_pthread_set_cfg, and note the stack
+    /// size for Task::Profiler if any setting was changed
     ~Config();
   };
 }  // namespace Task
@@ -1,20 +1,74 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <concepts>
+#include <cstdint>
 #include <thread>
+#include <type_traits>
 
 #include "Config.h"
 #include "Query.h"
+#include "telemetry/Telemetry.hpp"
+#include "telemetry/Trace.hpp"
 #include "utils/print.hpp"
 
 using namespace std::chrono_literals;
 
 namespace Task {
+  /// What a Periodic does with the releases it missed while a cycle
+  /// ran over its period. Pick one with skip(), catch_up() or degrade().
+  struct Overrun {
+    enum class Policy : uint8_t {
+      /// Drop the missed releases and wait for the next one on the grid
+      SKIP,
+      /// Run the missed releases back to back, up to a burst, then skip
+      CATCH_UP,
+      /// Drop the missed releases and call a cheaper fallback once instead
+      DEGRADE,
+    };
+
+    Policy policy;
+    /// Most late releases run back to back after an overrun, for CATCH_UP
+    uint32_t burst;
+    /// Called with the number of releases dropped, for DEGRADE
+    void (*fallback)(uint32_t missed);
+
+    static constexpr auto skip() -> Overrun { return { .policy = Policy::SKIP, .burst = 0, .fallback = nullptr }; }
+    static constexpr auto catch_up(uint32_t burst) -> Overrun { return { .policy = Policy::CATCH_UP, .burst = burst, .fallback = nullptr }; }
+    static constexpr auto degrade(void (*fallback)(uint32_t)) -> Overrun { return { .policy = Policy::DEGRADE, .burst = 0, .fallback = fallback }; }
+  };
+
   struct Periodic final : std::thread {
+    /// Releases since start-up and what became of them
+    struct Stats {
+      /// Times the function ran
+      uint32_t runs;
+      /// Cycles that ran past their next release
+      uint32_t overruns;
+      /// Releases dropped
+      uint32_t skipped;
+      /// Late releases run back to back
+      uint32_t caught_up;
+      /// Times the fallback ran
+      uint32_t degraded;
+    };
+
+   private:
+    struct Counters {
+      std::atomic<uint32_t> runs = 0;
+      std::atomic<uint32_t> overruns = 0;
+      std::atomic<uint32_t> skipped = 0;
+      std::atomic<uint32_t> caught_up = 0;
+      std::atomic<uint32_t> degraded = 0;
+    };
+
+    Counters counters;
+
     template <typename FnType, typename... ArgsType>
-    static constexpr auto wrap(const std::chrono::milliseconds period, FnType&& fn, ArgsType&&... args) {
+    static constexpr auto wrap(const std::chrono::milliseconds period, const Overrun overrun, Counters* counters, FnType&& fn, ArgsType&&... args) {
       if (Query::pthread::priority() == Config::AUTOMATIC_PRIORITY) {
         // I can't just call period.count() on the log10 because C++ is a mess.
         //
@@ -33,26 +87,97 @@ namespace Task {
       }
 
       const auto wrapper = [=]() {
+        // Timing goes out as telemetry rather than text, printing every
+        // cycle would cost more than most of the tasks themselves.
+        const auto name = Query::this_thread::name();
+        auto telemetry = Telemetry::Channel{ name };
+
         auto next_exec = std::chrono::steady_clock::now();
+        // Late releases still to run back to back, for CATCH_UP
+        uint32_t pending = 0;
+
         while (true) {
-          std::this_thread::sleep_until(next_exec);
-          next_exec += period;
+          if (pending == 0) {
+            std::this_thread::sleep_until(next_exec);
+            next_exec += period;
+          }
 
           const auto start = std::chrono::steady_clock::now();
+          Telemetry::Trace::begin(name);
           fn(args...);
+          Telemetry::Trace::end(name);
+          counters->runs.fetch_add(1, std::memory_order_relaxed);
+
+          const auto end = std::chrono::steady_clock::now();
+          const auto took = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+          const auto slack = std::chrono::duration_cast<std::chrono::microseconds>(next_exec - end).count();
+          telemetry.push(Telemetry::Kind::TASK, 0, took, slack);
+
+          // Accounted for when the overrun was found, a slow one only
+          // shows on the run after the burst
+          if (pending > 0) {
+            --pending;
+            counters->caught_up.fetch_add(1, std::memory_order_relaxed);
+            continue;
+          }
+
+          if (end <= next_exec)
+            continue;
 
-          if (const auto end = std::chrono::steady_clock::now(); end > next_exec)
-            Utils::println<Utils::Colors::RED>("{} missed its deadline", Query::this_thread::name());
-          else
-            Utils::println<Utils::Colors::GREEN>("{} took {} µs", Query::this_thread::name(), std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+          Utils::println<Utils::Colors::RED>("{} missed its deadline", name);
+          counters->overruns.fetch_add(1, std::memory_order_relaxed);
+
+          // Releases already due, the one at next_exec included
+          const auto missed = static_cast<uint32_t>((end - next_exec) / period) + 1;
+
+          // Back onto the period grid, with the next release still ahead
+          next_exec += missed * period;
+
+          if (overrun.policy == Overrun::Policy::CATCH_UP) {
+            // Run the due ones right away, but no more than the burst
+            pending = std::min(missed, overrun.burst);
+            counters->skipped.fetch_add(missed - pending, std::memory_order_relaxed);
+            continue;
+          }
+
+          counters->skipped.fetch_add(missed, std::memory_order_relaxed);
+
+          if (overrun.policy == Overrun::Policy::DEGRADE and overrun.fallback != nullptr) {
+            overrun.fallback(missed);
+            counters->degraded.fetch_add(1, std::memory_order_relaxed);
+          }
         }
       };
 
       return wrapper;
     }
 
+   public:
+    /// Run fn(args...) every period, skipping whatever a late cycle made it miss
+    template <typename FnType, typename... ArgsType>
+      requires(not std::same_as<std::remove_cvref_t<FnType>, Overrun>)
+    Periodic(const std::chrono::milliseconds period, FnType&& fn, ArgsType&&... args) : Periodic(period, Overrun::skip(), std::forward<FnType>(fn), std::forward<ArgsType>(args)...) {
+    }
+
+    /// Run fn(args...) every period, handling late cycles as overrun says
     template <typename FnType, typename... ArgsType>
-    Periodic(const std::chrono::milliseconds period, FnType&& fn, ArgsType&&... args) : std::thread(wrap(period, std::forward<FnType>(fn), std::forward<ArgsType>(args)...)) {
+    Periodic(const std::chrono::milliseconds period, const Overrun overrun, FnType&& fn, ArgsType&&... args) {
+      // Started only now, so the task never sees the counters uninitialized
+      std::thread::operator=(std::thread(wrap(period, overrun, &counters, std::forward<FnType>(fn), std::forward<ArgsType>(args)...)));
+    }
+
+    // The task keeps a pointer to the counters, so they can't move
+    Periodic(Periodic&&) = delete;
+    auto operator=(Periodic&&) -> Periodic& = delete;
+
+    auto stats() const -> Stats {
+      return {
+        .runs = counters.runs.load(std::memory_order_relaxed),
+        .overruns = counters.overruns.load(std::memory_order_relaxed),
+        .skipped = counters.skipped.load(std::memory_order_relaxed),
+        .caught_up = counters.caught_up.load(std::memory_order_relaxed),
+        .degraded = counters.degraded.load(std::memory_order_relaxed),
+      };
     }
 
     ~Periodic() {
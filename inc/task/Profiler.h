@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace Task {
+  /// CPU and stack usage of every task in the system, not just the
+  /// calling one like Query::this_thread, built on the FreeRTOS run time
+  /// stats (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS).
+  ///
+  /// Every sample() covers the time since the previous one, so calling
+  /// it from a Periodic gives a rolling view. Everything lives inside the
+  /// object, sampling never allocates. Call it from a single task only.
+  ///
+  /// FreeRTOS doesn't keep the size of a task's stack, only how much of
+  /// it was never touched. Task::Config and Task::Static note the sizes
+  /// they create tasks with, so those tasks also get a suggested size.
+  class Profiler {
+   public:
+    /// Tasks tracked, with more than this sample() reports nothing
+    static constexpr size_t MAX_TASKS = 32;
+
+    /// Headroom kept on top of the deepest stack use seen
+    static constexpr size_t STACK_MARGIN = 512;
+
+    struct Usage {
+      std::array<char, configMAX_TASK_NAME_LEN> name;
+      /// Core the task is pinned to, tskNO_AFFINITY if it floats
+      BaseType_t core;
+      UBaseType_t priority;
+      /// Share of one core over the window, in tenths of a percent
+      uint32_t cpu_permille;
+      /// Least free stack the task ever had, in bytes
+      uint32_t free_stack;
+      /// Stack the task was created with, 0 if unknown
+      uint32_t stack_size;
+      /// Stack to configure instead, 0 if unknown
+      uint32_t suggested_stack;
+    };
+
+    struct Report {
+      std::array<Usage, MAX_TASKS> tasks;
+      size_t count;
+      /// Busy share of each core, in tenths of a percent
+      std::array<uint32_t, portNUM_PROCESSORS> core_load;
+      /// Length of the window in run time counter ticks, microseconds
+      /// with the default esp_timer clock
+      uint32_t window;
+    };
+
+   private:
+    std::array<TaskStatus_t, MAX_TASKS> current;
+    std::array<TaskStatus_t, MAX_TASKS> previous;
+    size_t previous_count = 0;
+    configRUN_TIME_COUNTER_TYPE previous_total = 0;
+
+    Report last = {};
+
+   public:
+    /// Take a snapshot and compare it with the previous one
+    auto sample() -> const Report&;
+
+    /// The result of the last sample()
+    auto report() const -> const Report& { return last; }
+
+    /// Print the last report as a table, one line per task
+    auto print() const -> void;
+
+    /// Note the stack size a task is created with.
+    ///
+    /// Later calls for the same name win, tasks sharing a name are
+    /// expected to share their stack size too.
+    static auto expect(const char* name, size_t stack_size) -> void;
+
+    /// Stack size that covers the deepest use seen plus STACK_MARGIN,
+    /// rounded up to 256 bytes
+    static auto suggest(size_t stack_size, size_t free_stack) -> size_t;
+  };
+}  // namespace Task
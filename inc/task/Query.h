@@ -16,6 +16,8 @@ namespace Task {
       static auto name() -> const char*;
       /// Get the core in which this task is running
       static auto core() -> BaseType_t;
+      /// Get the core this task is pinned to, tskNO_AFFINITY if none
+      static auto affinity() -> BaseType_t;
       /// Get the priority of this task
       static auto priority() -> UBaseType_t;
       /// Get the free stack of this task
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "task/Profiler.h"
+
+namespace Task {
+  /// A FreeRTOS task whose control block and stack live inside this
+  /// object, so starting it never touches the heap.
+  ///
+  /// Static tasks are meant to be started once and then woken with
+  /// notify() for every job, instead of spawning a thread per job.
+  ///
+  /// NOTE: The object must outlive the task, in practice it should be
+  /// a member of something static.
+  template <size_t stack_size = 4096>
+  class Static final {
+   private:
+    StaticTask_t tcb;
+    // ESP-IDF sizes stacks in bytes, StackType_t is a byte there
+    std::array<StackType_t, stack_size / sizeof(StackType_t)> stack;
+    TaskHandle_t handle = nullptr;
+
+   public:
+    Static() = default;
+    Static(const Static&) = delete;
+    auto operator=(const Static&) -> Static& = delete;
+
+    /// Create the task.
+    ///
+    /// @param entry Task body, it should loop on wait() forever.
+    /// @param arg Handed to the entry function.
+    /// @param name Name of the task.
+    /// @param priority FreeRTOS priority.
+    /// @param core Core to pin it to, tskNO_AFFINITY to let it float.
+    auto start(TaskFunction_t entry, void* arg, const char* name, UBaseType_t priority, BaseType_t core = tskNO_AFFINITY) -> void {
+      Profiler::expect(name, stack_size);
+      handle = xTaskCreateStaticPinnedToCore(entry, name, stack_size, arg, priority, stack.data(), &tcb, core);
+    }
+
+    /// Whether start() was already called
+    auto started() const -> bool { return handle != nullptr; }
+
+    /// Wake the task up for one more job
+    auto notify() -> void { xTaskNotifyGive(handle); }
+
+    /// Called from inside the task: sleep until the next notify()
+    static auto wait() -> void { ulTaskNotifyTake(pdTRUE, portMAX_DELAY); }
+
+    ~Static() {
+      if (handle)
+        vTaskDelete(handle);
+    }
+  };
+}  // namespace Task
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "utils/Ring.hpp"
+
+namespace Telemetry {
+  /// What a sample describes, and therefore how to read its fields
+  enum class Kind : uint8_t {
+    /// a, b: the channel's name, as 8 ASCII bytes
+    ANNOUNCE = 0,
+    /// tag: axis index, a: position [steps], b: velocity [steps/s]
+    AXIS = 1,
+    /// a: segment index, b: segments still queued behind it, -1 if unknown
+    SEGMENT = 2,
+    /// a: execution time [µs], b: slack left to the deadline [µs]
+    TASK = 3,
+    /// a: samples lost on this channel so far
+    DROPPED = 4,
+  };
+
+  /// What producers push: fixed size, no allocation, no formatting.
+  struct Sample {
+    uint32_t timestamp_us;
+    Kind kind;
+    uint8_t tag;
+    int32_t a;
+    int32_t b;
+  };
+
+  /// What goes over the wire. Little endian, 17 bytes, so a receiver
+  /// can always resynchronize on SYNC and check the CRC-8 (poly 0x07)
+  /// computed over every byte before it.
+  struct [[gnu::packed]] Frame {
+    static constexpr uint8_t SYNC = 0xA5;
+
+    uint8_t sync;
+    Kind kind;
+    uint8_t channel;
+    uint8_t tag;
+    uint32_t timestamp_us;
+    int32_t a;
+    int32_t b;
+    uint8_t crc;
+  };
+  static_assert(sizeof(Frame) == 17);
+
+  /// Samples each channel can hold before the producer starts dropping
+  static constexpr size_t CHANNEL_DEPTH = 64;
+  /// Channels the sender can drain
+  static constexpr size_t MAX_CHANNELS = 16;
+
+  /// Most frames per second a link of the given baud rate can carry
+  /// (8N1), a theoretical bound that ignores gaps between bytes
+  constexpr auto max_rate(uint32_t baud) -> uint32_t { return baud / 10 / sizeof(Frame); }
+
+  /// Timestamp used for every sample, wraps after ~71 minutes
+  inline auto now() -> uint32_t { return static_cast<uint32_t>(esp_timer_get_time()); }
+
+  /// A producer's end of the telemetry stream.
+  ///
+  /// Each producer owns its own channel, which is what keeps the ring
+  /// single-producer. Pushing never blocks: if the sender falls behind
+  /// the sample is counted as dropped and reported later instead.
+  ///
+  /// NOTE: Channels register themselves on construction and must live
+  /// as long as the task that owns them, like everything else here.
+  /// Past MAX_CHANNELS, registering fails with an error on the console
+  /// and the channel's samples are never sent.
+  class Channel final {
+   private:
+    Utils::Ring<Sample, CHANNEL_DEPTH> ring;
+    std::atomic<uint32_t> dropped = 0;
+    const char* channel_name;
+
+    friend struct Sender;
+
+   public:
+    explicit Channel(const char* name);
+    ~Channel();
+
+    Channel(const Channel&) = delete;
+    auto operator=(const Channel&) -> Channel& = delete;
+
+    auto push(Kind kind, uint8_t tag, int32_t a, int32_t b) -> void {
+      if (not ring.push({ .timestamp_us = now(), .kind = kind, .tag = tag, .a = a, .b = b }))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto name() const -> const char* { return channel_name; }
+
+    /// Samples this channel had to throw away so far
+    auto lost() const -> uint32_t { return dropped.load(std::memory_order_relaxed); }
+  };
+
+  struct Stats {
+    /// Frames written since start
+    uint32_t sent;
+    /// Samples lost across every channel since start
+    uint32_t dropped;
+    /// Frames written during the last full second
+    uint32_t per_second;
+    /// Best second seen so far
+    uint32_t peak_per_second;
+    /// What the link can carry, 0 if unbounded
+    uint32_t link_limit;
+  };
+
+  /// Start the sender task writing frames to a file (stdout by
+  /// default, which is the console UART on target).
+  auto start(FILE* out = stdout) -> void;
+
+  /// Start the sender task writing frames to a dedicated UART, so the
+  /// binary stream doesn't mix with the console.
+  auto start(uart_port_t port, int tx_pin, uint32_t baud) -> void;
+
+  /// Throughput counters of the sender
+  auto stats() -> Stats;
+}  // namespace Telemetry
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "sdkconfig.h"
+#include "utils/Realtime.hpp"
+
+/// Event timeline of the last moments of a run, to see what ran when
+/// after a stutter: which task held the core, which interrupt came
+/// late, what waited on what.
+///
+/// Trace points record a cycle-counter timestamp into a ring per core,
+/// with interrupts masked for the few cycles it takes, so they are safe
+/// from tasks and ISRs alike and never block. Older events are
+/// overwritten. dump() writes the rings out in the Chrome trace event
+/// format, which chrome://tracing and ui.perfetto.dev open.
+///
+/// Everything compiles to nothing unless CONFIG_TRIPTERON_TRACE is set.
+namespace Telemetry::Trace {
+#ifdef CONFIG_TRIPTERON_TRACE
+  inline constexpr bool ENABLED = true;
+#else
+  inline constexpr bool ENABLED = false;
+#endif
+
+  enum class Phase : uint8_t {
+    BEGIN,
+    END,
+    INSTANT,
+  };
+
+  /// Record one event. name must outlive the trace, a string literal
+  /// or a task name.
+  REALTIME_ATTR auto record(Phase phase, const char* name, int32_t arg) -> void;
+
+  /// Start of a span, closed by the end() with the same name on the
+  /// same task or interrupt
+  REALTIME_ATTR inline auto begin(const char* name, int32_t arg = 0) -> void {
+    if constexpr (ENABLED)
+      record(Phase::BEGIN, name, arg);
+  }
+
+  REALTIME_ATTR inline auto end(const char* name, int32_t arg = 0) -> void {
+    if constexpr (ENABLED)
+      record(Phase::END, name, arg);
+  }
+
+  /// A point in time, with no duration
+  REALTIME_ATTR inline auto instant(const char* name, int32_t arg = 0) -> void {
+    if constexpr (ENABLED)
+      record(Phase::INSTANT, name, arg);
+  }
+
+  /// A span covering the rest of the enclosing scope
+  class Scope final {
+   private:
+    const char* name;
+    int32_t arg;
+
+   public:
+    REALTIME_ATTR explicit Scope(const char* name, int32_t arg = 0) : name(name), arg(arg) { begin(name, arg); }
+    REALTIME_ATTR ~Scope() { end(name, arg); }
+
+    Scope(const Scope&) = delete;
+    auto operator=(const Scope&) -> Scope& = delete;
+  };
+
+  /// Write everything recorded so far as Chrome trace JSON. Recording
+  /// pauses meanwhile, events in between are lost.
+  auto dump(FILE* out = stdout) -> void;
+
+  /// Forget everything recorded so far
+  auto clear() -> void;
+}  // namespace Telemetry::Trace
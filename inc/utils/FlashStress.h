@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Utils {
+  /// Keeps the flash busy with NVS writes, to measure what flash
+  /// activity does to motion (see CONFIG_TRIPTERON_FLASH_STRESS).
+  ///
+  /// Each write is committed, so the cache goes off on every one of them,
+  /// and NVS erases whole sectors as pages fill up, the longest stalls
+  /// the flash can cause.
+  ///
+  /// NOTE: This wears the flash out, it's meant for test runs only.
+  struct FlashStress {
+    /// Create the writer task, it stays idle until resume() is called
+    static auto start() -> void;
+
+    /// Start writing
+    static auto resume() -> void;
+
+    /// Stop writing after the current write
+    static auto pause() -> void;
+
+    /// Committed writes since start()
+    static auto writes() -> uint32_t;
+  };
+}  // namespace Utils
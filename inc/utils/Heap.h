@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Utils {
+  /// Heap allocation accounting, fed by the ESP-IDF heap hooks
+  /// (CONFIG_TRIPTERON_HEAP_ACCOUNTING), so it sees every allocation:
+  /// malloc, operator new, pthread stacks and FreeRTOS objects alike.
+  /// Counts stay at 0 with the hooks off.
+  ///
+  /// The firmware is meant to allocate only while starting up. Once
+  /// seal() is called, every further allocation is counted separately,
+  /// and with CONFIG_TRIPTERON_ZERO_HEAP it trips an assert on the spot.
+  struct Heap {
+    /// Allocations since boot
+    static auto allocations() -> uint32_t;
+
+    /// Allocations since seal() was called
+    static auto allocations_since_seal() -> uint32_t;
+
+    /// Declare the end of start-up, from here on the heap is off-limits
+    static auto seal() -> void;
+
+    /// Whether seal() has been called
+    static auto sealed() -> bool;
+  };
+}  // namespace Utils
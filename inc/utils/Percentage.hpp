@@ -4,11 +4,18 @@
 #include <cstdint>
 
 namespace Utils {
+  /**
+   * @brief Fixed-point percentage of a stroke, in steps of 0.0001% so
+   * that even a long stroke resolves finer than one microstep.
+   */
   struct Percentage {
-    uint16_t value;
+    /// Units per percent, 100_percent is a million
+    static constexpr uint32_t SCALE = 10'000;
 
-    constexpr Percentage(double percentage) : value(std::round(percentage * 100.0)) {}
-    constexpr operator uint16_t() const { return value; }
+    uint32_t value;
+
+    constexpr Percentage(double percentage) : value(std::round(percentage * SCALE)) {}
+    constexpr operator uint32_t() const { return value; }
   };
 
   namespace literals {
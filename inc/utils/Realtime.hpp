@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
+#include "sdkconfig.h"
+
+// Placement tier for the real-time path.
+//
+// While the flash is being written (NVS, OTA...) the cache is off and
+// anything still in flash can't run. On the ESP32 both cores are parked
+// for the duration, so tasks wait regardless. Only interrupts flagged
+// ESP_INTR_FLAG_IRAM keep running, which matters because the RMT refills
+// its 64 symbol window from an interrupt, and a late refill means a gap
+// in the step train.
+//
+// Everything those interrupts run goes in IRAM through REALTIME_ATTR,
+// inline helpers included since -Og doesn't inline them reliably.
+// Everything they touch goes in DRAM through REALTIME_DATA_ATTR. Static
+// objects already live there, so that is only needed for flash-resident
+// constants such as lookup tables.
+//
+// With CONFIG_TRIPTERON_REALTIME_IRAM off the attributes disappear to
+// save IRAM, and flash writes may then stall motion.
+#ifdef CONFIG_TRIPTERON_REALTIME_IRAM
+#define REALTIME_ATTR IRAM_ATTR
+#define REALTIME_DATA_ATTR DRAM_ATTR
+#define REALTIME_INTR_FLAGS ESP_INTR_FLAG_IRAM
+#else
+#define REALTIME_ATTR
+#define REALTIME_DATA_ATTR
+#define REALTIME_INTR_FLAGS 0
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace Utils {
+  /**
+   * @brief Lock-free single-producer/single-consumer ring buffer.
+   *
+   * One task may push and one (possibly on the other core) may pop,
+   * without either of them ever blocking. Pushing into a full ring
+   * fails instead of overwriting, so the consumer never sees torn data.
+   *
+   * @tparam T Element type, copied in and out.
+   * @tparam N Capacity, must be a power of two.
+   */
+  template <typename T, size_t N>
+  class Ring final {
+    static_assert(N > 0 and (N & (N - 1)) == 0, "N must be a power of two!");
+
+   private:
+    std::array<T, N> items;
+
+    // Free-running counters, only ever masked when indexing, so that
+    // head == tail means empty and head - tail == N means full.
+    std::atomic<size_t> head = 0;
+    std::atomic<size_t> tail = 0;
+
+   public:
+    /**
+     * @brief Append an item. Producer side only.
+     *
+     * @return false if the ring is full and the item was not stored.
+     */
+    auto push(const T& item) -> bool {
+      const auto h = head.load(std::memory_order_relaxed);
+      if (h - tail.load(std::memory_order_acquire) == N)
+        return false;
+
+      items[h & (N - 1)] = item;
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Take the oldest item out. Consumer side only.
+     */
+    auto pop() -> std::optional<T> {
+      const auto t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire))
+        return std::nullopt;
+
+      const auto item = items[t & (N - 1)];
+      tail.store(t + 1, std::memory_order_release);
+      return item;
+    }
+
+    /**
+     * @brief Number of items waiting. Only a snapshot, safe from either side.
+     */
+    auto size() const -> size_t { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    static constexpr auto capacity() -> size_t { return N; }
+  };
+}  // namespace Utils
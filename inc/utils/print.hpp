@@ -1,9 +1,30 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdio>
 #include <format>
 #include <print>
 
+#include "sdkconfig.h"
+#include "telemetry/Trace.hpp"
+
 namespace Utils {
+  namespace {
+    template <typename... ArgsType>
+    inline auto emit(std::format_string<ArgsType...> fmt, ArgsType&&... args) -> void {
+#ifdef CONFIG_TRIPTERON_ZERO_HEAP
+      // std::print formats into a std::string first, which allocates.
+      // Longer lines get truncated rather than touching the heap.
+      std::array<char, 192> buffer;
+      const auto result = std::format_to_n(buffer.data(), buffer.size(), fmt, std::forward<ArgsType>(args)...);
+      fwrite(buffer.data(), 1, std::min<size_t>(result.size, buffer.size()), stdout);
+#else
+      std::print(fmt, std::forward<ArgsType>(args)...);
+#endif
+    }
+  }  // namespace
+
   enum class Colors {
     RED,
     GREEN,
@@ -17,71 +38,76 @@ namespace Utils {
 
   template <Colors color, typename... ArgsType>
   inline auto print(std::format_string<ArgsType...> fmt, ArgsType&&... args) -> void {
+    // Printing is slow enough to show up in a timeline
+    const Telemetry::Trace::Scope trace{ "print" };
     if constexpr (color == Colors::RED) {
-      std::print("\x1B[31m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[31m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::GREEN) {
-      std::print("\x1B[32m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[32m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::YELLOW) {
-      std::print("\x1B[33m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[33m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::BLUE) {
-      std::print("\x1B[34m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[34m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::MAGENTA) {
-      std::print("\x1B[35m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[35m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::CYAN) {
-      std::print("\x1B[36m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[36m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::WHITE) {
-      std::print("\x1B[37m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::print("\x1B[39m");
+      emit("\x1B[37m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m");
     } else if constexpr (color == Colors::DEFAULT) {
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
     }
   }
 
   template <Colors color, typename... ArgsType>
   inline auto println(std::format_string<ArgsType...> fmt, ArgsType&&... args) -> void {
+    // Printing is slow enough to show up in a timeline
+    const Telemetry::Trace::Scope trace{ "print" };
     if constexpr (color == Colors::RED) {
-      std::print("\x1B[31m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[31m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::GREEN) {
-      std::print("\x1B[32m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[32m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::YELLOW) {
-      std::print("\x1B[33m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[33m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::BLUE) {
-      std::print("\x1B[34m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[34m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::MAGENTA) {
-      std::print("\x1B[35m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[35m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::CYAN) {
-      std::print("\x1B[36m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[36m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::WHITE) {
-      std::print("\x1B[37m");
-      std::print(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
-      std::println("\x1B[39m");
+      emit("\x1B[37m");
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\x1B[39m\n");
     } else if constexpr (color == Colors::DEFAULT) {
-      std::println(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit(std::forward<std::format_string<ArgsType...>>(fmt), std::forward<ArgsType>(args)...);
+      emit("\n");
     }
   }
 
@@ -1,97 +1,145 @@
-// #include "peripherals/GPIO.hpp"
-#include <cmath>
-#include <numbers>
+#include <algorithm>
+#include <array>
 
+// #include "peripherals/GPIO.hpp"
+#include "robot/Console.hpp"
+#include "robot/Path.hpp"
+#include "robot/Pipeline.hpp"
 #include "robot/Tripteron.hpp"
 #include "task/Periodic.hpp"
+#include "task/Profiler.h"
+#include "telemetry/Telemetry.hpp"
+#include "telemetry/Trace.hpp"
+#include "utils/FlashStress.h"
+#include "utils/Heap.h"
 #include "utils/Percentage.hpp"
 #include "utils/print.hpp"
 
-template <size_t N>
-constexpr auto generate_circle_path(uint16_t centerX, uint16_t centerY, uint16_t radius, uint16_t zHeight) {
-  std::array<Robot::Tripteron::Position, N> path{ { 0, 0, 0 } };
-
-  for (size_t i = 0; i < N; ++i) {
-    const float angle = (2.0f * std::numbers::pi * i) / N;
-    path[i] = {
-      static_cast<uint16_t>(centerX + radius * std::cos(angle)),
-      static_cast<uint16_t>(centerY + radius * std::sin(angle)),
-      zHeight
-    };
-  }
-  return path;
-}
-
-/**
- * @brief Generates three circles, one in each primary plane (XY, YZ, ZX).
- * * Circle 1: XY Plane (Flat) at fixed Z
- * Circle 2: YZ Plane (Side) at fixed X
- * Circle 3: ZX Plane (Front) at fixed Y
- * * * @tparam RES_PER_CIRCLE Resolution of points per circle
- * @param center Center point for the "cube" space these circles inhabit
- * @param radius Radius of the circles
- * * @return A std::array containing the full path for all 3 circles.
- */
-template <size_t RES_PER_CIRCLE>
-constexpr auto generate_circles_for_each_plane(Robot::Tripteron::Position center, uint16_t radius) -> std::array<Robot::Tripteron::Position, (RES_PER_CIRCLE + 1) * 3> {
-  // Total points: 3 circles * (resolution + 1 to close loop)
-  constexpr size_t POINTS_PER_CIRCLE = RES_PER_CIRCLE + 1;
-  constexpr size_t TOTAL_POINTS = POINTS_PER_CIRCLE * 3;
-
-  std::array<Robot::Tripteron::Position, TOTAL_POINTS> fullPath;
-  size_t idx = 0;
-
-  // --- Circle 1: XY Plane (Z is fixed) ---
-  // Moving in X and Y, holding Z steady.
-  for (size_t i = 0; i < POINTS_PER_CIRCLE; ++i) {
-    float theta = (2.0f * std::numbers::pi_v<float> * i) / RES_PER_CIRCLE;
-
-    auto x = static_cast<uint16_t>(center.x + radius * std::cos(theta));
-    auto y = static_cast<uint16_t>(center.y + radius * std::sin(theta));
-    auto z = center.z;  // Fixed Z height
-
-    fullPath[idx++] = { x, y, z };
-  }
-
-  // --- Circle 2: YZ Plane (X is fixed) ---
-  // Moving in Y and Z, holding X steady.
-  // Note: We might want to offset X slightly or keep it at center.x
-  for (size_t i = 0; i < POINTS_PER_CIRCLE; ++i) {
-    float theta = (2.0f * std::numbers::pi_v<float> * i) / RES_PER_CIRCLE;
-
-    auto x = center.x;  // Fixed X position
-    auto y = static_cast<uint16_t>(center.y + radius * std::cos(theta));
-    auto z = static_cast<uint16_t>(center.z + radius * std::sin(theta));
-
-    fullPath[idx++] = { x, y, z };
-  }
-
-  // --- Circle 3: ZX Plane (Y is fixed) ---
-  // Moving in Z and X, holding Y steady.
-  for (size_t i = 0; i < POINTS_PER_CIRCLE; ++i) {
-    float theta = (2.0f * std::numbers::pi_v<float> * i) / RES_PER_CIRCLE;
-
-    auto x = static_cast<uint16_t>(center.x + radius * std::sin(theta));
-    auto y = center.y;  // Fixed Y position
-    auto z = static_cast<uint16_t>(center.z + radius * std::cos(theta));
-
-    fullPath[idx++] = { x, y, z };
-  }
-
-  return fullPath;
-}
-
 extern "C" void app_main(void) {
   using namespace Utils::literals;
 
   static Robot::Tripteron robot;
-  // static constexpr auto circle = generate_circles_for_each_plane<40>({ 50_percent, 50_percent, 50_percent }, 30_percent);
-  static constexpr auto circle = generate_circle_path<40>(50_percent, 50_percent, 30_percent, 20_percent);
+  // Targets are queued from here (core 0), planned and stepped on core 1
+  static Robot::Pipeline pipeline{ robot };
+  // Stored rather than lazy, so that every cycle after the first replays
+  // its plan from the trajectory cache
+  static const auto circle = [] {
+    std::array<Robot::Tripteron::Position, 40> points;
+    std::ranges::copy(Robot::Path::circle(Robot::Tripteron::Position{ 50_percent, 50_percent, 20_percent }, 30_percent, points.size()), points.begin());
+    return points;
+  }();
+  // Computed point by point as the robot goes, so the resolution costs no memory
+  // static const auto circle = Robot::Path::spiral(Robot::Tripteron::Position{ 50_percent, 50_percent, 50_percent }, 5_percent, 30_percent, 4.0f, 400);
+
+  // Binary telemetry on its own UART, decode with tools/telemetry.py
+  Telemetry::start(UART_NUM_2, 17, 921'600);
+  // Feed override from the console, e.g. "M220 S50" to run at half speed
+  Robot::Console::start();
+
+  // Every task is created before calibrating, from here on nothing
+  // should touch the heap anymore (see CONFIG_TRIPTERON_ZERO_HEAP).
+  Task::Config().with_name("sampler").with_priority(2).pinned_to_core(Task::Config::IO_CORE).done();
+  // A late sample is worthless, drop it rather than bunching them up
+  static Task::Periodic sampler(5ms, Task::Overrun::skip(), []() { robot.sample(); });
+
+  // CPU share per core and stack use of every task, to right-size stacks
+  static Task::Profiler profiler;
+  Task::Config().with_name("profiler").with_priority(1).with_stack_size(4096).pinned_to_core(Task::Config::IO_CORE).done();
+  static Task::Periodic profiling(5000ms, []() {
+    profiler.sample();
+    profiler.print();
+  });
+  Task::Config().done();
+
+#ifdef CONFIG_TRIPTERON_FLASH_STRESS
+  Utils::FlashStress::start();
+#endif
+
+  // Resonance of the frame along each axis, as measured with an
+  // accelerometer on the effector. 0 leaves an axis unshaped.
+  static constexpr std::array<float, Robot::Tripteron::AXES> RESONANCE_HZ = { 0.0f, 0.0f, 0.0f };
+  for (size_t axis = 0; axis < RESONANCE_HZ.size(); ++axis)
+    if (RESONANCE_HZ[axis] > 0.0f)
+      robot.shape(axis, Robot::Shaper{ Robot::Shaper::Type::ZVD, RESONANCE_HZ[axis] });
+
+  // Calibrating on the dispatch task starts the axis workers on core 1 too.
+  // Then the circle runs the single-task way, planning and stepping one
+  // point after the other, as the baseline the pipeline has to beat. The
+  // first run plans it into the cache, the second replays it like every
+  // pipeline cycle does.
+  static uint32_t single_task_us = 0;
+  pipeline.start([](auto& self) {
+    self.calibrate();
+    self.move(circle);
+    const auto started = Telemetry::now();
+    self.move(circle);
+    single_task_us = Telemetry::now() - started;
+  });
+  pipeline.drain();
+  Utils::Heap::seal();
+
+  uint32_t baseline_latency = 0;
+#ifdef CONFIG_TRIPTERON_FLASH_STRESS
+  // One quiet run first, so the report shows what the flash adds
+  pipeline.submit(circle);
+  pipeline.drain();
+  baseline_latency = robot.latency();
+  robot.reset_latency();
+  Utils::FlashStress::resume();
+#endif
+
+  // A second robot on the free RMT channels, each one driven from its own core.
+  // Endstops need pins with internal pull-ups, which 34 to 39 lack. 15 and 2
+  // are strapping pins, so their endstops must be open at reset.
+  //
+  // static Robot::TripteronOn<Robot::LinearAxis<4, 16, 33>, Robot::LinearAxis<5, 18, 15>, Robot::LinearAxis<19, 21, 2>> second{ "planner2", "motion2" };
+  // second.run_on(0, "second", [](auto& self) {
+  //   self.calibrate();
+  //   while (true)
+  //     self.move(circle);
+  // }).detach();
 
-  robot.calibrate();
   while (true) {
-    const auto path = std::span{ circle.data(), circle.size() };
-    robot.move(path);
+    const auto& path = circle;
+    const auto estimating = Telemetry::now();
+    const auto estimate = robot.estimate(path);
+    const auto started = Telemetry::now();
+    pipeline.submit(path);
+    pipeline.drain();
+    const auto took = Telemetry::now() - started;
+
+    Utils::println<Utils::Colors::BLUE>("cycle: {} us estimated in {} us over {} points (longest {} us), took {} us at {}% feed", estimate.duration_us, started - estimating, estimate.points, estimate.longest_point_us, took, Robot::Feed::current());
+    const auto overhead = static_cast<int64_t>(took) - static_cast<int64_t>(estimate.duration_us);
+    Utils::println<Utils::Colors::BLUE>("cycle: {:+} us against the estimate ({:.2f}x), {} us per point", overhead, estimate.duration_us == 0 ? 0.0 : static_cast<double>(took) / estimate.duration_us, estimate.points == 0 ? 0 : overhead / static_cast<int64_t>(estimate.points));
+    // A cycle well over its estimate stuttered somewhere, the timeline
+    // shows where (see CONFIG_TRIPTERON_TRACE)
+    if (Telemetry::Trace::ENABLED and took > estimate.duration_us * 11 / 10)
+      Telemetry::Trace::dump();
+
+    Utils::println<Utils::Colors::BLUE>("cycle: peak {} steps/s, step rate off by up to {} ppm", *std::ranges::max_element(estimate.peak_rate), *std::ranges::max_element(estimate.error_ppm));
+    if (estimate.out_of_range > 0 or estimate.clamped > 0)
+      Utils::println<Utils::Colors::YELLOW>("cycle: {} points out of range, {} with pauses cut short", estimate.out_of_range, estimate.clamped);
+
+    const auto stats = Telemetry::stats();
+    Utils::println<Utils::Colors::BLUE>("telemetry: {} frames/s (peak {}, link {}), {} dropped", stats.per_second, stats.peak_per_second, stats.link_limit, stats.dropped);
+#ifdef CONFIG_TRIPTERON_HEAP_ACCOUNTING
+    const auto allocations = Utils::Heap::allocations_since_seal();
+    const auto segments = robot.segments();
+    Utils::println<Utils::Colors::BLUE>("heap: {:.3f} allocations per segment since calibration ({} over {} segments)", segments == 0 ? 0.0 : static_cast<double>(allocations) / segments, allocations, segments);
+#endif
+
+    const auto cache = robot.cache_stats();
+    Utils::println<Utils::Colors::BLUE>("trajectory cache: {} hits, {} misses, {} evictions, {}/{} bytes", cache.hits, cache.misses, cache.evictions, cache.bytes_used, cache.bytes_budget);
+
+    const auto stages = pipeline.report();
+    Utils::println<Utils::Colors::BLUE>("pipeline: {} points/s, busy ingest {}% plan {}% dispatch {}%, {} underruns, {} waits for room", stages.throughput, stages.ingest.utilization, stages.plan.utilization, stages.dispatch.utilization, stages.underruns, stages.backpressure);
+    Utils::println<Utils::Colors::BLUE>("pipeline: cycle {} us against {} us from a single task ({:.2f}x the throughput)", took, single_task_us, took == 0 ? 0.0 : static_cast<double>(single_task_us) / took);
+
+    const auto sampling = sampler.stats();
+    Utils::println<Utils::Colors::BLUE>("sampler: {} runs, {} overruns, {} releases skipped", sampling.runs, sampling.overruns, sampling.skipped);
+
+    const auto latency = robot.latency();
+    Utils::println<Utils::Colors::BLUE>("step interrupts: worst {} us late, {} us over baseline, {} flash writes", latency, latency - std::min(latency, baseline_latency), Utils::FlashStress::writes());
     std::this_thread::sleep_for(1s);
   }
 }
@@ -0,0 +1,88 @@
+#include "robot/Console.hpp"
+
+#include <array>
+#include <charconv>
+#include <string_view>
+#include <thread>
+
+#include "robot/Feed.hpp"
+#include "task/Config.h"
+#include "utils/print.hpp"
+
+namespace Robot::Console {
+  namespace {
+    /// Longest line kept, anything past it is cut off and fails to parse
+    constexpr size_t LINE = 64;
+
+    uart_port_t uart = UART_NUM_MAX;
+
+    auto trim(std::string_view text) -> std::string_view {
+      while (not text.empty() and text.front() == ' ')
+        text.remove_prefix(1);
+      while (not text.empty() and text.back() == ' ')
+        text.remove_suffix(1);
+      return text;
+    }
+
+    auto feed(std::string_view args) -> void {
+      if (args.empty()) {
+        Utils::println<Utils::Colors::CYAN>("feed: {}%, asked for {}%", Feed::current(), Feed::requested());
+        return;
+      }
+
+      uint32_t percent = 0;
+      const auto end = args.data() + args.size();
+      const auto [last, error] = std::from_chars(args.data() + 1, end, percent);
+      if (args.front() != 'S' or error != std::errc{} or last != end) {
+        Utils::println<Utils::Colors::YELLOW>("console: expected M220 S<percent>, got '{}'", args);
+        return;
+      }
+
+      Feed::set(percent);
+      Utils::println<Utils::Colors::CYAN>("feed: ramping to {}%", Feed::requested());
+    }
+
+    auto handle(std::string_view line) -> void {
+      line = trim(line);
+      if (line.empty())
+        return;
+
+      if (line.starts_with("M220") and (line.size() == 4 or line[4] == ' '))
+        feed(trim(line.substr(4)));
+      else
+        Utils::println<Utils::Colors::YELLOW>("console: unknown command '{}'", line);
+    }
+
+    auto run() -> void {
+      std::array<char, LINE> line;
+      size_t length = 0;
+
+      while (true) {
+        char c;
+        if (uart_read_bytes(uart, &c, 1, portMAX_DELAY) != 1)
+          continue;
+
+        if (c == '\r' or c == '\n') {
+          handle({ line.data(), length });
+          length = 0;
+        } else if (length < line.size()) {
+          line[length++] = c;
+        }
+      }
+    }
+  }  // namespace
+
+  auto start(uart_port_t port) -> void {
+    uart = port;
+
+    // Receive only: the TX buffer stays 0 so printing keeps writing
+    // straight to the FIFO, and the RX buffer must be larger than it.
+    ESP_ERROR_CHECK(uart_driver_install(port, 256, 0, 0, nullptr, 0));
+
+    // Commands are rare and nothing waits on them, so the reader sits
+    // just above telemetry on the I/O core.
+    Task::Config().with_name("console").pinned_to_core(Task::Config::IO_CORE).with_priority(Task::Config::MIN_PRIORITY + 2).with_stack_size(3072).done();
+    std::thread(run).detach();
+    Task::Config().done();
+  }
+}  // namespace Robot::Console
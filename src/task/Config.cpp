@@ -3,6 +3,8 @@
 #include <algorithm>
 
 #include "esp_log.h"
+#include "sdkconfig.h"
+#include "task/Profiler.h"
 
 namespace Task {
   [[nodiscard]] Config::Config(bool keep_current) {
@@ -16,30 +18,39 @@ namespace Task {
 
   auto Config::done() -> void {}
 
-  auto Config::with_stack_size(size_t size) -> Config {
+  auto Config::with_stack_size(size_t size) -> Config& {
     config.stack_size = size;
+    configured = true;
     return *this;
   }
 
-  auto Config::with_priority(size_t priority) -> Config {
+  auto Config::with_priority(size_t priority) -> Config& {
     config.prio = std::clamp(priority, MIN_PRIORITY, MAX_PRIORITY);
+    configured = true;
     return *this;
   }
 
-  auto Config::with_name(const char* name) -> Config {
+  auto Config::with_name(const char* name) -> Config& {
     config.thread_name = name;
+    configured = true;
     return *this;
   }
 
-  auto Config::pinned_to_core(int core) -> Config {
+  auto Config::pinned_to_core(int core) -> Config& {
     config.pin_to_core = core;
+    configured = true;
     return *this;
   }
 
-  auto Config::inherit_further() -> Config {
+  auto Config::inherit_further() -> Config& {
     config.inherit_cfg = true;
+    configured = true;
     return *this;
   }
 
-  Config::~Config() { esp_pthread_set_cfg(&config); }
+  Config::~Config() {
+    esp_pthread_set_cfg(&config);
+    if (configured)
+      Profiler::expect(config.thread_name ? config.thread_name : CONFIG_PTHREAD_TASK_NAME_DEFAULT, config.stack_size);
+  }
 }  // namespace Task
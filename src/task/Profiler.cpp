@@ -0,0 +1,119 @@
+#include "task/Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "sdkconfig.h"
+#include "utils/print.hpp"
+
+namespace Task {
+  namespace {
+    struct Expected {
+      std::array<char, configMAX_TASK_NAME_LEN> name;
+      uint32_t stack_size;
+    };
+
+    // Tasks are created from any core, guard the table with a spinlock
+    portMUX_TYPE expected_lock = portMUX_INITIALIZER_UNLOCKED;
+    std::array<Expected, Profiler::MAX_TASKS> expected = { { { { "main" }, CONFIG_ESP_MAIN_TASK_STACK_SIZE } } };
+    size_t expected_count = 1;
+
+    auto stack_size_of(const char* name) -> uint32_t {
+      uint32_t size = 0;
+      taskENTER_CRITICAL(&expected_lock);
+      for (size_t i = 0; i < expected_count; ++i)
+        if (std::strncmp(expected[i].name.data(), name, configMAX_TASK_NAME_LEN) == 0)
+          size = expected[i].stack_size;
+      taskEXIT_CRITICAL(&expected_lock);
+      return size;
+    }
+  }  // namespace
+
+  auto Profiler::expect(const char* name, size_t stack_size) -> void {
+    taskENTER_CRITICAL(&expected_lock);
+    auto* entry = std::find_if(expected.begin(), expected.begin() + expected_count, [&](const Expected& known) {
+      return std::strncmp(known.name.data(), name, configMAX_TASK_NAME_LEN) == 0;
+    });
+
+    if (entry == expected.begin() + expected_count and expected_count < expected.size()) {
+      std::strncpy(entry->name.data(), name, entry->name.size() - 1);
+      ++expected_count;
+    }
+
+    if (entry != expected.end())
+      entry->stack_size = stack_size;
+    taskEXIT_CRITICAL(&expected_lock);
+  }
+
+  auto Profiler::suggest(size_t stack_size, size_t free_stack) -> size_t {
+    constexpr size_t GRANULARITY = 256;
+    const auto used = stack_size - std::min(free_stack, stack_size);
+    return (used + STACK_MARGIN + GRANULARITY - 1) / GRANULARITY * GRANULARITY;
+  }
+
+  auto Profiler::sample() -> const Report& {
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    const size_t count = uxTaskGetSystemState(current.data(), current.size(), &total);
+
+    // Unsigned differences survive the counter wrapping around
+    const uint32_t window = total - previous_total;
+    last.count = count;
+    last.window = window;
+
+    for (size_t i = 0; i < count; ++i) {
+      const auto& task = current[i];
+      auto& usage = last.tasks[i];
+
+      // Tasks created since the last sample count from zero
+      const auto* before = std::find_if(previous.begin(), previous.begin() + previous_count, [&](const TaskStatus_t& old) { return old.xHandle == task.xHandle; });
+      const auto ran = task.ulRunTimeCounter - (before != previous.begin() + previous_count ? before->ulRunTimeCounter : 0);
+
+      std::strncpy(usage.name.data(), task.pcTaskName, usage.name.size() - 1);
+      usage.name.back() = '\0';
+      usage.core = xTaskGetCoreID(task.xHandle);
+      usage.priority = task.uxCurrentPriority;
+      usage.cpu_permille = window == 0 ? 0 : static_cast<uint32_t>(uint64_t{ ran } * 1000 / window);
+      usage.free_stack = task.usStackHighWaterMark;
+      usage.stack_size = stack_size_of(usage.name.data());
+      usage.suggested_stack = usage.stack_size == 0 ? 0 : suggest(usage.stack_size, usage.free_stack);
+    }
+
+    // Whatever the idle task of a core didn't get, something else did
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core) {
+      const auto idle = xTaskGetIdleTaskHandleForCore(core);
+      const auto* task = std::find_if(current.begin(), current.begin() + count, [&](const TaskStatus_t& status) { return status.xHandle == idle; });
+      const auto idle_permille = task != current.begin() + count ? last.tasks[task - current.begin()].cpu_permille : 0;
+      last.core_load[core] = 1000 - std::min<uint32_t>(idle_permille, 1000);
+    }
+
+    std::copy(current.begin(), current.begin() + count, previous.begin());
+    previous_count = count;
+    previous_total = total;
+
+    if (count == 0)
+      Utils::println<Utils::Colors::YELLOW>("Profiler: more than {} tasks, nothing sampled", MAX_TASKS);
+
+    return last;
+  }
+
+  auto Profiler::print() const -> void {
+    for (size_t core = 0; core < last.core_load.size(); ++core)
+      Utils::println<Utils::Colors::MAGENTA>("core {}: {:3}.{}% busy", core, last.core_load[core] / 10, last.core_load[core] % 10);
+
+    Utils::println<Utils::Colors::MAGENTA>("{:<16} {:>4} {:>4} {:>6} {:>6} {:>6} {:>9}", "task", "core", "prio", "cpu", "free", "stack", "suggested");
+    for (size_t i = 0; i < last.count; ++i) {
+      const auto& task = last.tasks[i];
+      const auto cpu = task.cpu_permille;
+
+      if (task.core == tskNO_AFFINITY)
+        Utils::print<Utils::Colors::DEFAULT>("{:<16} {:>4} ", task.name.data(), "any");
+      else
+        Utils::print<Utils::Colors::DEFAULT>("{:<16} {:>4} ", task.name.data(), task.core);
+
+      if (task.stack_size == 0)
+        Utils::println<Utils::Colors::DEFAULT>("{:>4} {:>3}.{}% {:>6} {:>6} {:>9}", task.priority, cpu / 10, cpu % 10, task.free_stack, "?", "?");
+      else
+        Utils::println<Utils::Colors::DEFAULT>("{:>4} {:>3}.{}% {:>6} {:>6} {:>9}", task.priority, cpu / 10, cpu % 10, task.free_stack, task.stack_size, task.suggested_stack);
+    }
+  }
+}  // namespace Task
@@ -8,6 +8,8 @@ namespace Task {
 
   auto Query::this_thread::core() -> BaseType_t { return xPortGetCoreID(); }
 
+  auto Query::this_thread::affinity() -> BaseType_t { return xTaskGetCoreID(nullptr); }
+
   auto Query::this_thread::priority() -> UBaseType_t { return uxTaskPriorityGet(nullptr); }
 
   auto Query::this_thread::free_stack() -> UBaseType_t { return uxTaskGetStackHighWaterMark(nullptr); }
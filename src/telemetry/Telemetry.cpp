@@ -0,0 +1,216 @@
+#include "telemetry/Telemetry.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "sdkconfig.h"
+#include "task/Config.h"
+#include "utils/print.hpp"
+
+namespace Telemetry {
+  namespace {
+    using write_t = void (*)(const uint8_t* data, size_t size);
+
+    std::array<std::atomic<Channel*>, MAX_CHANNELS> channels = {};
+
+    std::atomic<uint32_t> sent = 0;
+    std::atomic<uint32_t> per_second = 0;
+    std::atomic<uint32_t> peak_per_second = 0;
+    uint32_t link_limit = 0;
+
+    FILE* file = nullptr;
+    uart_port_t uart = UART_NUM_MAX;
+
+    auto crc8(const uint8_t* data, size_t size) -> uint8_t {
+      uint8_t crc = 0;
+      for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+          crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+      }
+      return crc;
+    }
+
+    auto write_file(const uint8_t* data, size_t size) -> void {
+      fwrite(data, 1, size, file);
+      fflush(file);
+    }
+
+    auto write_uart(const uint8_t* data, size_t size) -> void { uart_write_bytes(uart, data, size); }
+  }  // namespace
+
+  struct Sender {
+    static constexpr size_t BATCH = 32;
+    static constexpr auto IDLE = std::chrono::milliseconds(2);
+
+    static auto frame(uint8_t channel, const Sample& sample) -> Frame {
+      Frame out = {
+        .sync = Frame::SYNC,
+        .kind = sample.kind,
+        .channel = channel,
+        .tag = sample.tag,
+        .timestamp_us = sample.timestamp_us,
+        .a = sample.a,
+        .b = sample.b,
+        .crc = 0,
+      };
+      out.crc = crc8(reinterpret_cast<const uint8_t*>(&out), sizeof(Frame) - 1);
+      return out;
+    }
+
+    static auto announce(uint8_t channel, const char* name) -> Frame {
+      std::array<char, 8> packed = {};
+      std::strncpy(packed.data(), name, packed.size());
+
+      Sample sample = { .timestamp_us = now(), .kind = Kind::ANNOUNCE, .tag = 0, .a = 0, .b = 0 };
+      std::memcpy(&sample.a, packed.data(), 4);
+      std::memcpy(&sample.b, packed.data() + 4, 4);
+      return frame(channel, sample);
+    }
+
+    static auto run(write_t write) -> void {
+      // What the receiver was last told about each slot, so a channel
+      // is announced once and drops are reported only when they grow
+      std::array<Channel*, MAX_CHANNELS> announced = {};
+      std::array<uint32_t, MAX_CHANNELS> reported = {};
+
+      std::array<Frame, BATCH> batch;
+      auto window_start = now();
+      uint32_t window_sent = 0;
+
+      while (true) {
+        size_t count = 0;
+        auto flush = [&]() {
+          if (count == 0)
+            return;
+          write(reinterpret_cast<const uint8_t*>(batch.data()), count * sizeof(Frame));
+          sent.fetch_add(count, std::memory_order_relaxed);
+          window_sent += count;
+          count = 0;
+        };
+
+        bool idle = true;
+        for (uint8_t slot = 0; slot < MAX_CHANNELS; ++slot) {
+          Channel* channel = channels[slot].load(std::memory_order_acquire);
+          if (channel == nullptr)
+            continue;
+
+          if (announced[slot] != channel) {
+            announced[slot] = channel;
+            reported[slot] = 0;
+            batch[count++] = announce(slot, channel->name());
+          }
+
+          if (const auto dropped = channel->lost(); dropped != reported[slot]) {
+            reported[slot] = dropped;
+            batch[count++] = frame(slot, { .timestamp_us = now(), .kind = Kind::DROPPED, .tag = 0, .a = static_cast<int32_t>(dropped), .b = 0 });
+          }
+
+          // Leave room for the two bookkeeping frames of the next slot
+          while (true) {
+            if (count >= BATCH - 2)
+              flush();
+
+            const auto sample = channel->ring.pop();
+            if (not sample)
+              break;
+
+            batch[count++] = frame(slot, *sample);
+            idle = false;
+          }
+        }
+        flush();
+
+        if (const auto elapsed = now() - window_start; elapsed >= 1'000'000) {
+          const auto rate = static_cast<uint32_t>(uint64_t{ window_sent } * 1'000'000 / elapsed);
+          per_second.store(rate, std::memory_order_relaxed);
+          if (rate > peak_per_second.load(std::memory_order_relaxed))
+            peak_per_second.store(rate, std::memory_order_relaxed);
+
+          window_start += elapsed;
+          window_sent = 0;
+        }
+
+        if (idle)
+          std::this_thread::sleep_for(IDLE);
+      }
+    }
+
+    static auto spawn(write_t write) -> void {
+      // Lowest priority that still beats idle: telemetry must never
+      // delay motion, it only gets whatever CPU is left, and only on
+      // the I/O core.
+      Task::Config().with_name("telemetry").pinned_to_core(Task::Config::IO_CORE).with_priority(Task::Config::MIN_PRIORITY + 1).with_stack_size(3072).done();
+      std::thread(run, write).detach();
+      Task::Config().done();
+    }
+  };
+
+  Channel::Channel(const char* name) : channel_name(name) {
+    for (auto& slot : channels) {
+      Channel* expected = nullptr;
+      if (slot.compare_exchange_strong(expected, this))
+        return;
+    }
+
+    Utils::println<Utils::Colors::RED>("telemetry: all {} channels taken, {} won't be sent", MAX_CHANNELS, name);
+  }
+
+  Channel::~Channel() {
+    for (auto& slot : channels) {
+      Channel* expected = this;
+      if (slot.compare_exchange_strong(expected, nullptr))
+        return;
+    }
+  }
+
+  auto start(FILE* out) -> void {
+    file = out;
+#ifdef CONFIG_ESP_CONSOLE_UART_BAUDRATE
+    if (out == stdout)
+      link_limit = max_rate(CONFIG_ESP_CONSOLE_UART_BAUDRATE);
+#endif
+    Sender::spawn(write_file);
+  }
+
+  auto start(uart_port_t port, int tx_pin, uint32_t baud) -> void {
+    uart = port;
+    link_limit = max_rate(baud);
+
+    const uart_config_t config = {
+      .baud_rate = static_cast<int>(baud),
+      .data_bits = UART_DATA_8_BITS,
+      .parity = UART_PARITY_DISABLE,
+      .stop_bits = UART_STOP_BITS_1,
+      .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+      .rx_flow_ctrl_thresh = 0,
+      .source_clk = UART_SCLK_DEFAULT,
+      .flags = {},
+    };
+
+    // The RX buffer is never used, but the driver insists on one
+    // larger than the hardware FIFO.
+    ESP_ERROR_CHECK(uart_driver_install(port, 256, 4096, 0, nullptr, 0));
+    ESP_ERROR_CHECK(uart_param_config(port, &config));
+    ESP_ERROR_CHECK(uart_set_pin(port, tx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    Sender::spawn(write_uart);
+  }
+
+  auto stats() -> Stats {
+    uint32_t dropped = 0;
+    for (const auto& slot : channels)
+      if (const Channel* channel = slot.load(std::memory_order_acquire))
+        dropped += channel->lost();
+
+    return {
+      .sent = sent.load(std::memory_order_relaxed),
+      .dropped = dropped,
+      .per_second = per_second.load(std::memory_order_relaxed),
+      .peak_per_second = peak_per_second.load(std::memory_order_relaxed),
+      .link_limit = link_limit,
+    };
+  }
+}  // namespace Telemetry
@@ -0,0 +1,175 @@
+#include "telemetry/Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace Telemetry::Trace {
+#ifdef CONFIG_TRIPTERON_TRACE
+  namespace {
+    constexpr size_t DEPTH = CONFIG_TRIPTERON_TRACE_DEPTH;
+    constexpr uint32_t CYCLES_PER_US = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    // Tasks each core can name, the rest show up by handle only
+    constexpr size_t MAX_TASKS = 32;
+
+    struct Event {
+      uint64_t cycles;
+      const char* name;
+      // nullptr for interrupts
+      TaskHandle_t task;
+      int32_t arg;
+      Phase phase;
+    };
+
+    // Copied when a task first records, so the dump can name tasks
+    // deleted since. A handle reused by a later task keeps the name of
+    // the first one.
+    struct TaskName {
+      TaskHandle_t task;
+      std::array<char, configMAX_TASK_NAME_LEN> name;
+    };
+
+    // Only ever written by its own core, with interrupts masked
+    struct Ring {
+      std::array<Event, DEPTH> events;
+      uint32_t written = 0;
+      // The cycle counter is 32 bits and wraps every 2^32 cycles, 17.9 s
+      // at 240 MHz. This extends it, as long as the core records
+      // something every wrap.
+      uint32_t last_cycles = 0;
+      uint64_t high_cycles = 0;
+      // Where this core's cycle count lines up with esp_timer
+      uint64_t origin_cycles = 0;
+      int64_t origin_us = -1;
+
+      std::array<TaskName, MAX_TASKS> tasks;
+      size_t named = 0;
+      // Task of the previous event, to skip the lookup while it runs on
+      TaskHandle_t last_task = nullptr;
+    };
+
+    std::array<Ring, portNUM_PROCESSORS> rings;
+    std::atomic<bool> paused = false;
+
+    // What a host build swaps out, everything else is portable
+    REALTIME_ATTR auto cycles() -> uint32_t { return esp_cpu_get_cycle_count(); }
+    REALTIME_ATTR auto core() -> size_t { return esp_cpu_get_core_id(); }
+    REALTIME_ATTR auto in_isr() -> bool { return xPortInIsrContext(); }
+
+    auto to_us(const Ring& ring, uint64_t cycles) -> double {
+      return static_cast<double>(ring.origin_us) + static_cast<double>(static_cast<int64_t>(cycles - ring.origin_cycles)) / CYCLES_PER_US;
+    }
+
+    REALTIME_ATTR auto remember(Ring& ring, TaskHandle_t task) -> void {
+      if (task == nullptr or task == ring.last_task)
+        return;
+      ring.last_task = task;
+
+      for (size_t i = 0; i < ring.named; ++i)
+        if (ring.tasks[i].task == task)
+          return;
+      if (ring.named == ring.tasks.size())
+        return;
+
+      auto& entry = ring.tasks[ring.named++];
+      entry.task = task;
+      const char* name = pcTaskGetName(task);
+      size_t length = 0;
+      for (; length + 1 < entry.name.size() and name[length] != '\0'; ++length)
+        entry.name[length] = name[length];
+      entry.name[length] = '\0';
+    }
+
+    // Chrome wants a thread id per track. Interrupts get one per core,
+    // tasks their handle.
+    auto track(const Event& event, size_t core) -> uintptr_t { return event.task == nullptr ? core + 1 : reinterpret_cast<uintptr_t>(event.task); }
+  }  // namespace
+
+  REALTIME_ATTR auto record(Phase phase, const char* name, int32_t arg) -> void {
+    if (paused.load(std::memory_order_relaxed))
+      return;
+
+    const auto mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    auto& ring = rings[core()];
+
+    const auto now = cycles();
+    if (now < ring.last_cycles)
+      ring.high_cycles += uint64_t{ 1 } << 32;
+    ring.last_cycles = now;
+    const auto extended = ring.high_cycles | now;
+
+    if (ring.origin_us < 0) {
+      ring.origin_cycles = extended;
+      ring.origin_us = esp_timer_get_time();
+    }
+
+    const auto task = in_isr() ? nullptr : xTaskGetCurrentTaskHandle();
+    remember(ring, task);
+
+    ring.events[ring.written++ % DEPTH] = {
+      .cycles = extended,
+      .name = name,
+      .task = task,
+      .arg = arg,
+      .phase = phase,
+    };
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+  }
+
+  auto dump(FILE* out) -> void {
+    paused.store(true);
+    // Let a record() in flight on the other core finish
+    esp_rom_delay_us(10);
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    fprintf(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":0,\"args\":{\"name\":\"tripteron\"}}");
+
+    for (size_t core = 0; core < rings.size(); ++core) {
+      const auto& ring = rings[core];
+      fprintf(out, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"isr cpu%u\"}}", static_cast<unsigned>(core + 1), static_cast<unsigned>(core));
+
+      const auto count = std::min<uint32_t>(ring.written, DEPTH);
+      for (auto i = ring.written - count; i != ring.written; ++i) {
+        const auto& event = ring.events[i % DEPTH];
+        const char phase = event.phase == Phase::BEGIN ? 'B' : event.phase == Phase::END ? 'E' : 'i';
+        fprintf(out, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":0,\"tid\":%lu,\"ts\":%.3f,%s\"args\":{\"core\":%u,\"arg\":%ld}}", phase, event.name, static_cast<unsigned long>(track(event, core)), to_us(ring, event.cycles), event.phase == Phase::INSTANT ? "\"s\":\"t\"," : "", static_cast<unsigned>(core), static_cast<long>(event.arg));
+      }
+    }
+
+    // Tasks that ran on both cores are in both tables, name them once
+    for (size_t core = 0; core < rings.size(); ++core) {
+      for (size_t i = 0; i < rings[core].named; ++i) {
+        const auto& entry = rings[core].tasks[i];
+        const auto named_before = std::any_of(rings.begin(), rings.begin() + core, [&](const Ring& other) {
+          return std::any_of(other.tasks.begin(), other.tasks.begin() + other.named, [&](const TaskName& seen) { return seen.task == entry.task; });
+        });
+        if (not named_before)
+          fprintf(out, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}", static_cast<unsigned long>(reinterpret_cast<uintptr_t>(entry.task)), entry.name.data());
+      }
+    }
+
+    fprintf(out, "\n]}\n");
+    fflush(out);
+    paused.store(false);
+  }
+
+  auto clear() -> void {
+    paused.store(true);
+    esp_rom_delay_us(10);
+    for (auto& ring : rings)
+      ring.written = 0;
+    paused.store(false);
+  }
+#else
+  auto record(Phase, const char*, int32_t) -> void {}
+  auto dump(FILE* out) -> void { fprintf(out, "{\"traceEvents\":[]}\n"); }
+  auto clear() -> void {}
+#endif
+}  // namespace Telemetry::Trace
@@ -0,0 +1,60 @@
+#include "utils/FlashStress.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "esp_err.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "task/Config.h"
+
+namespace Utils {
+  namespace {
+    std::atomic<bool> active = false;
+    std::atomic<uint32_t> committed = 0;
+
+    auto run() -> void {
+      nvs_handle_t handle;
+      ESP_ERROR_CHECK(nvs_open("stress", NVS_READWRITE, &handle));
+
+      std::array<uint32_t, 256> blob = {};
+      while (true) {
+        if (not active.load(std::memory_order_relaxed)) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          continue;
+        }
+
+        // A different blob every time, so that NVS can't skip the write
+        blob[0] = committed.load(std::memory_order_relaxed);
+        ESP_ERROR_CHECK(nvs_set_blob(handle, "blob", blob.data(), sizeof(blob)));
+        ESP_ERROR_CHECK(nvs_commit(handle));
+        committed.fetch_add(1, std::memory_order_relaxed);
+
+        // Let the idle task in, the watchdog expects it every few seconds
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }  // namespace
+
+  auto FlashStress::start() -> void {
+    if (const auto err = nvs_flash_init(); err == ESP_ERR_NVS_NO_FREE_PAGES or err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+      ESP_ERROR_CHECK(nvs_flash_erase());
+      ESP_ERROR_CHECK(nvs_flash_init());
+    } else {
+      ESP_ERROR_CHECK(err);
+    }
+
+    // Low priority, it only needs to keep the flash busy while motion runs
+    Task::Config().with_name("flash").with_priority(Task::Config::MIN_PRIORITY + 1).with_stack_size(4096).done();
+    std::thread(run).detach();
+    Task::Config().done();
+  }
+
+  auto FlashStress::resume() -> void { active.store(true); }
+
+  auto FlashStress::pause() -> void { active.store(false); }
+
+  auto FlashStress::writes() -> uint32_t { return committed.load(std::memory_order_relaxed); }
+}  // namespace Utils
@@ -0,0 +1,43 @@
+#include "utils/Heap.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+#include "esp_attr.h"
+#include "sdkconfig.h"
+
+namespace Utils {
+  namespace {
+    std::atomic<uint32_t> total = 0;
+    std::atomic<uint32_t> after_seal = 0;
+    std::atomic<bool> is_sealed = false;
+  }  // namespace
+
+  auto Heap::allocations() -> uint32_t { return total.load(std::memory_order_relaxed); }
+
+  auto Heap::allocations_since_seal() -> uint32_t { return after_seal.load(std::memory_order_relaxed); }
+
+  auto Heap::seal() -> void { is_sealed.store(true); }
+
+  auto Heap::sealed() -> bool { return is_sealed.load(); }
+}  // namespace Utils
+
+// The heap calls these on every allocation and free, possibly with the
+// flash cache disabled, hence IRAM and nothing but atomics inside. Only
+// allocations matter here, but both hooks must be defined.
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void* ptr, size_t, uint32_t) {
+  if (ptr == nullptr)
+    return;
+
+  Utils::total.fetch_add(1, std::memory_order_relaxed);
+
+  if (Utils::is_sealed.load(std::memory_order_relaxed)) {
+    Utils::after_seal.fetch_add(1, std::memory_order_relaxed);
+#ifdef CONFIG_TRIPTERON_ZERO_HEAP
+    assert(false && "heap allocation after Utils::Heap::seal()");
+#endif
+  }
+}
+
+extern "C" IRAM_ATTR void esp_heap_trace_free_hook(void*) {}
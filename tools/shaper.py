@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Simulate the residual vibration left by a move, with and without input shaping.
+
+Shapes a move exactly like Robot::Shaper in inc/robot/Shaper.hpp, turns
+it into the step pulses the motor would send, and computes how much the
+frame is still ringing once the last pulse is out. The frame is modelled
+as one mode of vibration, which the shaper is tuned to. The actual
+resonance is swept around the tuned one, since a measurement is never
+exact:
+
+    ./tools/shaper.py --frequency 38 --damping 0.1 --pulses 200
+
+Residual vibration is given in steps and as a percentage of the unshaped
+move's, so 5% means the shaper removed 95% of the ringing.
+
+Pulses are whole steps, so a shaped move can only follow the ideal one
+to within half a step. With few pulses per period of the resonance that
+error leaves some ringing of its own, which no shaper removes. --period
+shows how a faster step rate lowers it.
+"""
+
+import argparse
+import cmath
+import math
+
+EI_TOLERANCE = 0.05
+
+
+def impulses(kind, frequency, damping):
+    """Amplitudes and times (us) of the shaper, as Shaper::Shaper() builds them."""
+    if kind == "none":
+        return [(1.0, 0)]
+
+    k = math.exp(-damping * math.pi / math.sqrt(1 - damping**2))
+    half_period = int(500_000 / (frequency * math.sqrt(1 - damping**2)))
+
+    amplitudes = {
+        "zv": [1, k],
+        "zvd": [1, 2 * k, k * k],
+        "ei": [0.25 * (1 + EI_TOLERANCE), 0.5 * (1 - EI_TOLERANCE) * k, 0.25 * (1 + EI_TOLERANCE) * k * k],
+    }[kind]
+
+    total = sum(amplitudes)
+    return [(a / total, i * half_period) for i, a in enumerate(amplitudes)]
+
+
+def shape(train, pulses, period):
+    """Phases of a shaped move as (pulses, period, lead), as Shaper::shape() computes them."""
+    if len(train) == 1 or pulses == 0:
+        return [(pulses, period, period)]
+
+    length = pulses * period
+    edges = sorted([t for _, t in train] + [t + length for _, t in train])
+
+    def made(t):
+        return pulses * sum(a * min(max(t - t0, 0), length) / length for a, t0 in train)
+
+    phases, done, last_edge = [], 0, -0.5 * period
+    for edge in range(len(edges) - 1):
+        start, stop = made(edges[edge]), made(edges[edge + 1])
+        if stop <= start:
+            continue
+
+        last = pulses if edge + 2 == len(edges) else min(pulses, int(stop + 0.5))
+        if last <= done:
+            continue
+
+        rate = (stop - start) / (edges[edge + 1] - edges[edge])
+        first_edge = edges[edge] + (done + 0.5 - start) / rate
+        lead = round(max(first_edge - last_edge, 1))
+        phases.append((last - done, round(1 / rate), lead))
+        last_edge += lead + (last - done - 1) * round(1 / rate)
+        done = last
+    return phases
+
+
+def pulse_times(phases):
+    """Rising edge of every pulse, in seconds."""
+    t = 0
+    for count, period, lead in phases:
+        t += lead
+        yield t / 1e6
+        for _ in range(count - 1):
+            t += period
+            yield t / 1e6
+
+
+def residual(times, frequency, damping):
+    """Amplitude of the ringing once the last pulse is out, in steps.
+
+    Every pulse is a one-step move of the carriage. Each one starts a
+    decaying oscillation of the effector, and these add up as phasors.
+    """
+    omega = 2 * math.pi * frequency
+    omega_d = omega * math.sqrt(1 - damping**2)
+
+    total, end = 0j, 0.0
+    for t in times:
+        total += cmath.exp(complex(damping * omega, -omega_d) * t)
+        end = t
+    return abs(total) * math.exp(-damping * omega * end) / math.sqrt(1 - damping**2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--frequency", type=float, default=38.0, help="resonance the shaper is tuned to, Hz")
+    parser.add_argument("--damping", type=float, default=0.1, help="damping ratio of the resonance")
+    parser.add_argument("--pulses", type=int, default=200, help="length of the move, in pulses")
+    parser.add_argument("--period", type=int, default=2000, help="period of the pulses, us (Motor::PULSE_US)")
+    parser.add_argument("--error", type=float, default=30.0, help="sweep the actual resonance over +-this %%")
+    args = parser.parse_args()
+
+    kinds = ["zv", "zvd", "ei"]
+    moves = {kind: shape(impulses(kind, args.frequency, args.damping), args.pulses, args.period) for kind in ["none"] + kinds}
+    times = {kind: list(pulse_times(phases)) for kind, phases in moves.items()}
+
+    print(f"{args.pulses} pulses at {1e6 / args.period:.0f} Hz, shapers tuned to {args.frequency} Hz, damping {args.damping}")
+    print("added time: " + ", ".join(f"{kind} {(times[kind][-1] - times['none'][-1]) * 1e3:.1f} ms" for kind in kinds))
+    print()
+    print(f"{'actual Hz':>9} {'unshaped':>9} " + " ".join(f"{kind:>7}" for kind in kinds))
+
+    steps = 10
+    for i in range(-steps, steps + 1):
+        actual = args.frequency * (1 + args.error / 100 * i / steps)
+        unshaped = residual(times["none"], actual, args.damping)
+        shaped = [residual(times[kind], actual, args.damping) for kind in kinds]
+        print(f"{actual:9.1f} {unshaped:9.3f} " + " ".join(f"{100 * v / unshaped:6.1f}%" if unshaped > 0 else f"{'-':>7}" for v in shaped))
+
+
+if __name__ == "__main__":
+    main()
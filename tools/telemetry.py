@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Decode the binary telemetry stream produced by Telemetry::Sender.
+
+Reads frames from a serial port, a capture file or stdin and prints one
+CSV line per sample:
+
+    ./tools/telemetry.py /dev/ttyUSB1 --baud 921600 > run.csv
+    ./tools/telemetry.py capture.bin
+    cat capture.bin | ./tools/telemetry.py -
+
+The frame layout mirrors Telemetry::Frame in inc/telemetry/Telemetry.hpp.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+FRAME = struct.Struct("<BBBBIiiB")
+
+KINDS = {
+    0: "announce",
+    1: "axis",
+    2: "segment",
+    3: "task",
+    4: "dropped",
+}
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def frames(stream):
+    """Yield decoded frames, resynchronizing on SYNC after any corruption."""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            return
+        buffer += chunk
+
+        while len(buffer) >= FRAME.size:
+            if buffer[0] != SYNC:
+                del buffer[0]
+                continue
+
+            raw = bytes(buffer[: FRAME.size])
+            if crc8(raw[:-1]) != raw[-1]:
+                del buffer[0]
+                continue
+
+            del buffer[: FRAME.size]
+            yield FRAME.unpack(raw)
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial  # pyserial, only needed for live capture
+
+        return serial.Serial(path, baud, timeout=1)
+    return open(path, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port, capture file or - for stdin")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--rate", action="store_true", help="print decoded frames per second to stderr")
+    args = parser.parse_args()
+
+    names = {}
+    window_start, window_count = time.monotonic(), 0
+
+    print("timestamp_us,channel,kind,tag,a,b")
+    for _, kind, channel, tag, timestamp, a, b, _ in frames(open_input(args.input, args.baud)):
+        if kind == 0:
+            names[channel] = struct.pack("<ii", a, b).rstrip(b"\0").decode("ascii", "replace")
+            continue
+
+        name = names.get(channel, str(channel))
+        print(f"{timestamp},{name},{KINDS.get(kind, kind)},{tag},{a},{b}")
+
+        if args.rate:
+            window_count += 1
+            if (elapsed := time.monotonic() - window_start) >= 1.0:
+                print(f"{window_count / elapsed:.0f} frames/s", file=sys.stderr)
+                window_start, window_count = time.monotonic(), 0
+
+
+if __name__ == "__main__":
+    main()